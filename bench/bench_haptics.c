@@ -0,0 +1,274 @@
+/*
+ * Copyright 2024 Roger Feese
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "../src/haptics.h"
+
+// Microbenchmarks of the haptics hot paths, run against a mock backend.
+//
+// usage: bench_haptics [latency_ns] [operations]
+//
+// Output is CSV, one row per benchmark, player count and effect count.
+
+static const int bench_players[] = { 1, 4, 8, 16 };
+static const int bench_effects[] = { 32, 256, 1024 };
+
+static long bench_latency = 0; // simulated driver latency of every backend call, in nanoseconds
+static long bench_operations = 100000; // timed operations per benchmark
+
+// Timing
+static inline long long Bench_now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((long long)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static void Bench_report(const char *name, int players, int effects, long long elapsed, long operations){
+	printf("%s,%d,%d,%ld,%ld,%.1f\n", name, players, effects, bench_latency, operations, (double)elapsed / operations);
+}
+
+// Mock backend
+// - Busy wait for the simulated driver latency
+static inline void Mock_driver(){
+	if(bench_latency){
+		long long until = Bench_now() + bench_latency;
+		while(Bench_now() < until){
+		}
+	}
+}
+
+static int mock_device; // device handle of every mock device
+static int mock_next_effect; // next device effect identifier
+
+static int Mock_init(void *data){
+	return 0;
+}
+
+static void *Mock_open(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info){
+	Mock_driver();
+	info->effects = 0;
+	info->playing = 0;
+	info->features = SDL_HAPTIC_CONSTANT | SDL_HAPTIC_GAIN;
+	return &mock_device;
+}
+
+static void Mock_close(void *data, void *device){
+	Mock_driver();
+}
+
+static int Mock_new_effect(void *data, void *device, union SDL_HapticEffect *effect){
+	Mock_driver();
+	return mock_next_effect++;
+}
+
+static int Mock_update_effect(void *data, void *device, int effect, union SDL_HapticEffect *definition){
+	Mock_driver();
+	return 0;
+}
+
+static void Mock_destroy_effect(void *data, void *device, int effect){
+	Mock_driver();
+}
+
+static int Mock_run_effect(void *data, void *device, int effect, Uint32 iterations){
+	Mock_driver();
+	return 0;
+}
+
+static int Mock_effect_call(void *data, void *device, int effect){
+	Mock_driver();
+	return 0;
+}
+
+static int Mock_call(void *data, void *device){
+	Mock_driver();
+	return 0;
+}
+
+static int Mock_set_gain(void *data, void *device, int gain){
+	Mock_driver();
+	return 0;
+}
+
+static int Mock_rumble(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms){
+	Mock_driver();
+	return 0;
+}
+
+static const HapticsBackend mock_backend = { NULL, Mock_init, Mock_open, Mock_close, Mock_new_effect, Mock_update_effect, Mock_destroy_effect, Mock_run_effect, Mock_effect_call, Mock_call, Mock_call, Mock_call, Mock_set_gain, Mock_rumble };
+
+// Benchmarks
+static char bench_joysticks[16]; // addresses standing in for joysticks, one per player
+
+static SDL_HapticEffect Bench_effect(int i){
+	SDL_HapticEffect effect = { .type = SDL_HAPTIC_CONSTANT };
+	effect.constant.length = 100 + (i % 100);
+	effect.constant.level = 0x4000 + (i % 0x4000);
+	return effect;
+}
+
+static inline SDL_Joystick *Bench_joystick(int player){
+	return (SDL_Joystick *)&bench_joysticks[player];
+}
+
+static void Bench_open_players(int players){
+	for(int p = 0; p < players; p++){
+		Haptics_open_joystick_for_player(Bench_joystick(p), p);
+		Haptics_player_set_enabled(p, 1);
+	}
+}
+
+// - Open every player, with all effects registered
+static void Bench_open(int players, int effects){
+	// opening uploads every effect, keep the number of uploads bounded
+	long rounds = (bench_operations / (players * effects)) + 1;
+	long long elapsed = 0;
+	for(long r = 0; r < rounds; r++){
+		long long start = Bench_now();
+		for(int p = 0; p < players; p++){
+			Haptics_open_joystick_for_player(Bench_joystick(p), p);
+		}
+		elapsed += Bench_now() - start;
+		for(int p = 0; p < players; p++){
+			Haptics_close_for_player(p);
+		}
+	}
+	Bench_report("open_joystick_for_player", players, effects, elapsed, rounds * players);
+}
+
+// - Fill the effect table, uploading to every player
+static void Bench_register(int players, int effects, int *handles){
+	Bench_open_players(players);
+	long rounds = (bench_operations / effects) + 1;
+	long long elapsed = 0;
+	for(long r = 0; r < rounds; r++){
+		for(int i = 0; i < effects; i++){
+			Haptics_remove_effect(handles[i]);
+		}
+		long long start = Bench_now();
+		for(int i = 0; i < effects; i++){
+			SDL_HapticEffect effect = Bench_effect(i);
+			handles[i] = Haptics_register_effect(&effect);
+		}
+		elapsed += Bench_now() - start;
+	}
+	Bench_report("register_effect", players, effects, elapsed, rounds * effects);
+}
+
+// - Change effect definitions, updating every player
+static void Bench_set(int players, int effects, int *handles){
+	long long start = Bench_now();
+	for(long n = 0; n < bench_operations; n++){
+		SDL_HapticEffect effect = Bench_effect(n);
+		Haptics_set_effect(&effect, handles[n % effects]);
+	}
+	Bench_report("set_effect", players, effects, Bench_now() - start, bench_operations);
+}
+
+// - Trigger effects across players
+static void Bench_run(int players, int effects, int *handles){
+	long long start = Bench_now();
+	for(long n = 0; n < bench_operations; n++){
+		Haptics_player_run_effect(n % players, handles[n % effects], 1);
+	}
+	Bench_report("player_run_effect", players, effects, Bench_now() - start, bench_operations);
+}
+
+// - Trigger one effect on every player, one call per player
+static void Bench_broadcast_loop(int players, int effects, int *handles){
+	long long start = Bench_now();
+	for(long n = 0; n < bench_operations; n++){
+		for(int p = 0; p < players; p++){
+			Haptics_player_run_effect(p, handles[n % effects], 1);
+		}
+	}
+	Bench_report("broadcast_loop", players, effects, Bench_now() - start, bench_operations);
+}
+
+// - Trigger one effect on every player in a single call
+static void Bench_broadcast_mask(int players, int effects, int *handles){
+	Uint32 mask = (players < 32) ? ((1u << players) - 1) : ~0u;
+	long long start = Bench_now();
+	for(long n = 0; n < bench_operations; n++){
+		Haptics_run_effect_mask(mask, handles[n % effects], 1);
+	}
+	Bench_report("broadcast_mask", players, effects, Bench_now() - start, bench_operations);
+}
+
+// - Trigger one effect on every player once per frame in async mode, timing only the game thread
+// The worker has gone back to sleep by the next frame, so every wake is a real one.
+static void Bench_broadcast_async(int players, int effects, int *handles, int mask){
+	if(!Haptics_set_async(1)){
+		return;
+	}
+	Uint32 bits = (players < 32) ? ((1u << players) - 1) : ~0u;
+	// a frame per operation, fewer of them as each one waits for the worker
+	long frames = (bench_operations / 10) + 1;
+	long long elapsed = 0;
+	for(long n = 0; n < frames; n++){
+		long long start = Bench_now();
+		if(mask){
+			Haptics_run_effect_mask(bits, handles[n % effects], 1);
+		}
+		else{
+			for(int p = 0; p < players; p++){
+				Haptics_player_run_effect(p, handles[n % effects], 1);
+			}
+		}
+		elapsed += Bench_now() - start;
+		Haptics_sync();
+	}
+	Haptics_set_async(0);
+	Bench_report(mask ? "broadcast_mask_async" : "broadcast_loop_async", players, effects, elapsed, frames);
+}
+
+int main(int argc, char *argv[]){
+	if(argc > 1){
+		bench_latency = atol(argv[1]);
+	}
+	if(argc > 2){
+		bench_operations = atol(argv[2]);
+	}
+	if((bench_latency < 0) || (bench_operations <= 0)){
+		fprintf(stderr, "usage: %s [latency_ns] [operations]\n", argv[0]);
+		return 1;
+	}
+
+	Haptics_set_backend(&mock_backend);
+	printf("benchmark,players,effects,latency_ns,operations,ns_per_op\n");
+	for(int pc = 0; pc < (int)(sizeof(bench_players) / sizeof(bench_players[0])); pc++){
+		for(int ec = 0; ec < (int)(sizeof(bench_effects) / sizeof(bench_effects[0])); ec++){
+			int players = bench_players[pc];
+			int effects = bench_effects[ec];
+			HapticsConfig config = { .max_players = players, .max_effects = effects };
+			if(!Haptics_init_with_config(&config)){
+				fprintf(stderr, "init failed for %d players, %d effects\n", players, effects);
+				return 1;
+			}
+			int *handles = calloc(effects, sizeof(int));
+			for(int i = 0; i < effects; i++){
+				SDL_HapticEffect effect = Bench_effect(i);
+				handles[i] = Haptics_register_effect(&effect);
+			}
+
+			Bench_open(players, effects);
+			Bench_register(players, effects, handles);
+			Bench_set(players, effects, handles);
+			Bench_run(players, effects, handles);
+			Bench_broadcast_loop(players, effects, handles);
+			Bench_broadcast_mask(players, effects, handles);
+			Bench_broadcast_async(players, effects, handles, 0);
+			Bench_broadcast_async(players, effects, handles, 1);
+
+			Haptics_close();
+			for(int i = 0; i < effects; i++){
+				Haptics_remove_effect(handles[i]);
+			}
+			free(handles);
+		}
+	}
+	return 0;
+}
@@ -66,6 +66,18 @@ void register_effects(){
 	Haptics_register_effect_at(&effect, HAPTIC_LEFTRIGHT2);
 }
 
+// Pre-defined haptic sequences
+int haptic_blast;
+
+void register_sequences(){
+	// explosion followed by a rumble
+	HapticsStep blast[] = {
+		{ .effect = HAPTIC_EXPLODE, .iterations = 1 },
+		{ .effect = HAPTIC_LEFTRIGHT1, .delay = 600, .iterations = 1, .gain = 6 },
+	};
+	haptic_blast = Haptics_register_sequence(blast, 2);
+}
+
 int main(int argc, char* argv[]){
 	SDL_Init(SDL_INIT_GAMECONTROLLER|SDL_INIT_VIDEO);
 	// We need a window to collect events from
@@ -75,7 +87,11 @@ int main(int argc, char* argv[]){
 	}
 
 	Haptics_init();
-	register_effects();
+	// effects compiled by tools/haptics_bank load in one go and reload when recompiled, defining them in code works too
+	if(Haptics_watch_bank("example.bank") < 0){
+		register_effects();
+	}
+	register_sequences();
 
 	int exit_signal = 0;
 	while(!exit_signal){
@@ -126,7 +142,13 @@ int main(int argc, char* argv[]){
 			if(e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_5){
 				Haptics_player_run_effect(0, HAPTIC_LEFTRIGHT2, 1);
 			}
+			if(e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_6){
+				Haptics_player_run_sequence(0, haptic_blast, 1);
+			}
 		}
+
+		// advance haptic sequences
+		Haptics_update(SDL_GetTicks());
 	}
 
 	Haptics_close();
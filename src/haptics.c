@@ -1,269 +1,3941 @@
 /*
  * Copyright 2024 Roger Feese
 */
+#include <stdatomic.h>
+#include <stddef.h>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <SDL2/SDL.h>
 #include "haptics.h"
 
-#define HAPTICS_MAX_EFFECTS 32
+#define HAPTICS_MAX_EFFECTS 32 // default effect table size
 #define HAPTICS_MAX_GAIN 9
+#define HAPTICS_MIXER_EFFECT (haptics.max_effects) // device effect slot of the software mixer
+
+// Effect handles pack the effect index with the generation of its slot
+#define HAPTICS_HANDLE_INDEX_BITS 16
+#define HAPTICS_HANDLE_INDEX_MASK 0xFFFF
+#define HAPTICS_HANDLE_GENERATION_MASK 0x7FFF
+
+// Software mixer voices of a player, one array per voice parameter so the mix loop vectorizes
+typedef struct HapticsMixer {
+	int count; // number of active voices
+	int *effect; // effect index of each voice
+	Uint32 *start; // tick count at which each voice starts, after the effect delay
+	float *length; // play time in milliseconds, all iterations
+	float *attack_rate; // 1 / attack length
+	float *attack_level; // level at the start of the attack, relative to the magnitude
+	float *fade_rate; // 1 / fade length
+	float *fade_level; // level at the end of the fade, relative to the magnitude
+	float *period_rate; // 1 / period, 0 for effects without a period
+	float *wave_offset; // waveform = offset + slope * phase + peak * |2 * phase - 1|
+	float *wave_slope;
+	float *wave_peak;
+	float *base; // magnitude at the start of the effect, 0 to 1
+	float *ramp; // magnitude change per millisecond
+	float *large; // large motor share of the magnitude
+	float *small; // small motor share of the magnitude
+	Uint16 large_magnitude; // motor magnitudes last pushed to the device
+	Uint16 small_magnitude;
+	Uint32 pushed; // tick count at which the mixer effect was last run
+} HapticsMixer;
+
+#define HAPTICS_MIXER_LANES 13 // float arrays per mixer
+#define HAPTICS_MIXER_LENGTH 1000 // play time of the mixer effect, re-run while the mix is steady
+
+// Device being opened by the worker thread, picked up by Haptics_update
+typedef enum HapticsOpeningState {
+	HAPTICS_OPENING_IDLE,
+	HAPTICS_OPENING_PENDING, // open queued, the worker owns the fields below
+	HAPTICS_OPENING_DONE, // device and info are set
+} HapticsOpeningState;
+
+typedef struct HapticsOpening {
+	atomic_int state; // HapticsOpeningState
+	SDL_Joystick *joystick;
+	void *device; // opened device, NULL when the joystick has no haptic device
+	HapticsDeviceInfo info;
+} HapticsOpening;
+
+#define HAPTICS_CACHE_LINE 64
 
 // Haptics data associated with a player
-struct _SDL_Haptic;
 typedef struct HapticsPlayer {
+	// read by triggers, kept within the first cache line
+	_Alignas(HAPTICS_CACHE_LINE) int mixing; // effects are mixed in software into the mixer effect
+	Uint32 clock; // effect use counter, for least-recently-used eviction
+	void *device; // backend device associated with the player
+	SDL_Joystick *rumble; // joystick rumbled directly when it has no haptic device
+	int *effect; // per-playerdevice effect identifiers, in the dense table of all players
+	Uint32 *used; // clock value at last use of each effect
+	Uint32 *until; // tick count at which each playing effect ends, 0 when idle
+	int voices; // number of effects the device can play at once, 0 when unknown
+	int playing; // number of effects currently playing
+	int slots; // number of effects the device can hold
+	int resident; // number of effects currently uploaded to the device
+
 	int enabled; // is haptics enabled preference
 	int gain; // haptics intensity / 9
-	struct _SDL_Haptic *device; // device associated with the player
-	int effect[HAPTICS_MAX_EFFECTS]; // per-playerdevice effect identifiers
+	int paused; // effects are paused
+	int hardware_gain; // device applies gain itself
+	int scaled; // device effects are uploaded from the gain scaled definitions
+	union SDL_HapticEffect *scaledDefinitions; // effect definitions pre-scaled to gain
+	Uint8 *altered; // effects changed on the device by a sequence step gain
+	Uint32 *retrigger; // by effect with a retrigger policy: tick of the last start when interval limited, else tick at which it ends, 0 when idle
+	Uint32 *extending; // bitmap of extended effects to restart when they end
+	int uploading; // effects are still being uploaded, a few per update, most recently used first
+	HapticsMixer mixer;
+	HapticsOpening opening; // background open in progress
 } HapticsPlayer;
 
-#define HAPTICS_MAX_PLAYERS 4
+_Static_assert(offsetof(HapticsPlayer, enabled) <= HAPTICS_CACHE_LINE, "fields read by triggers must fit in one cache line");
+
+#define HAPTICS_MAX_PLAYERS 4 // default player table size
+#define HAPTICS_UPLOADS_PER_UPDATE 2 // effects uploaded to each newly opened device per update in background hotplug mode
+
+// Device calls, issued directly or queued for the worker thread
+typedef enum HapticsCommandType {
+	HAPTICS_COMMAND_NEW,
+	HAPTICS_COMMAND_UPDATE,
+	HAPTICS_COMMAND_DESTROY,
+	HAPTICS_COMMAND_RUN,
+	HAPTICS_COMMAND_STOP,
+	HAPTICS_COMMAND_STOP_ALL,
+	HAPTICS_COMMAND_PAUSE,
+	HAPTICS_COMMAND_UNPAUSE,
+	HAPTICS_COMMAND_GAIN,
+	HAPTICS_COMMAND_CLOSE,
+	HAPTICS_COMMAND_SYNC,
+	HAPTICS_COMMAND_RUMBLE,
+	HAPTICS_COMMAND_OPEN,
+} HapticsCommandType;
+
+typedef struct HapticsCommand {
+	HapticsCommandType type;
+	int player;
+	int effect; // effect index
+	void *device;
+	SDL_Joystick *joystick; // rumble-only joystick, when there is no device
+	Uint32 value; // run iterations or gain percentage
+	union SDL_HapticEffect definition; // effect to upload, or left/right rumble levels
+} HapticsCommand;
+
+#define HAPTICS_QUEUE_SIZE 256 // power of two
+
+// Single producer / single consumer command ring feeding the worker thread
+typedef struct HapticsQueue {
+	HapticsCommand commands[HAPTICS_QUEUE_SIZE];
+	atomic_uint head; // next command to write, written by the game thread
+	atomic_uint tail; // next command to run, written by the worker
+	atomic_int quit;
+	SDL_sem *pending; // posted for each queued command
+	SDL_sem *synced; // posted when the worker reaches a sync command
+	SDL_Thread *thread;
+	int *effect; // device effect identifiers by player and effect, owned by the worker
+	int hold; // the worker is woken once for a group of commands while set
+	int held; // commands queued without waking the worker
+	struct HapticsContext *context; // context the worker issues device calls for
+	unsigned int queued;
+	unsigned int overflows;
+	unsigned int stalls;
+	atomic_uint failures;
+} HapticsQueue;
+
+#define HAPTICS_BATCH_SIZE 256
+
+// Device calls collected during a frame, issued by Haptics_flush
+typedef struct HapticsBatch {
+	HapticsCommand commands[HAPTICS_BATCH_SIZE];
+	int count;
+	int *trigger; // batch position + 1 of a pending run or stop, by player and effect
+	int *update; // batch position + 1 of a pending update, by player and effect
+	HapticsBatchStats stats;
+} HapticsBatch;
+
+// Immutable copy of the effect table, read by triggers from other threads
+typedef struct HapticsSnapshot {
+	int max_effects;
+	int *handles; // current handle of each effect slot
+	union SDL_HapticEffect definitions[]; // registered definitions, type 0 for free slots
+} HapticsSnapshot;
+
+#define HAPTICS_TRIGGER_QUEUE_SIZE 1024 // power of two
+#define HAPTICS_SYNCHRONIZE_SPINS 64 // checks for readers of a replaced snapshot before yielding between checks
+
+// Run or stop from another thread, waiting for the next update
+typedef struct HapticsTrigger {
+	atomic_uint sequence; // ring position the slot is ready for, written last by its producer
+	int player;
+	int effect; // effect handle
+	Uint32 iterations; // run iterations, 0 to stop
+} HapticsTrigger;
+
+// Triggers from any thread, queued in a bounded multi-producer ring drained by Haptics_update.
+// The effect table is published as snapshots, replaced read-copy-update style, so triggers check handles without a lock.
+typedef struct HapticsThreads {
+	SDL_threadID owner; // thread calling Haptics_update, running triggers directly
+	_Atomic(HapticsSnapshot *) snapshot; // current effect table snapshot
+	atomic_uint epoch; // flipped by publishers, selects the reader count readers join
+	atomic_uint readers[2]; // triggers reading a snapshot, by epoch parity
+	int hold; // publishing is deferred while registering many effects
+	int dirty; // effect table changed while publishing was deferred
+	HapticsTrigger triggers[HAPTICS_TRIGGER_QUEUE_SIZE];
+	atomic_uint head; // next slot claimed by a producer
+	unsigned int tail; // next slot drained by the owner
+	HapticsThreadStats stats; // written by the owner
+	atomic_uint overflows; // triggers dropped on a full ring
+	atomic_uint rejected; // triggers dropped for an invalid player or handle
+} HapticsThreads;
+
+// Traced operations, the library calls followed by the backend calls
+typedef enum HapticsTraceName {
+	HAPTICS_TRACE_RUN,
+	HAPTICS_TRACE_STOP,
+	HAPTICS_TRACE_REGISTER,
+	HAPTICS_TRACE_SET,
+	HAPTICS_TRACE_OPEN,
+	HAPTICS_TRACE_CLOSE,
+	HAPTICS_TRACE_CALLS, // backend calls, offset by HapticsBackendCall
+} HapticsTraceName;
+
+static const char *haptics_trace_names[] = { "run_effect", "stop_effect", "register_effect", "set_effect", "open_joystick_for_player", "close_for_player", "backend_open", "backend_close", "backend_new_effect", "backend_update_effect", "backend_destroy_effect", "backend_run_effect", "backend_stop_effect", "backend_stop_all", "backend_pause", "backend_unpause", "backend_set_gain", "backend_rumble" };
+
+typedef struct HapticsTraceEvent {
+	Uint64 start; // performance counter at the start of the operation
+	Uint64 duration; // performance counter ticks
+	int name; // HapticsTraceName
+	int player; // player index, -1 for the whole system
+	int effect; // effect handle or index, -1 when none
+} HapticsTraceEvent;
+
+// Ring of the most recent traced operations, written by the game thread
+typedef struct HapticsTrace {
+	unsigned int count; // events recorded, the ring keeps the last capacity of them
+	unsigned int capacity;
+	HapticsTraceEvent *events;
+} HapticsTrace;
+
+// Public calls written to a capture file
+typedef struct HapticsCapture {
+	FILE *file;
+	Uint64 last; // performance counter at the previous record
+	int nested; // depth of captured calls made from within a captured call
+	int failed; // a write failed, later records are dropped so the file stays readable up to it
+} HapticsCapture;
+
+// Effect bank file reloaded by Haptics_update when it changes
+typedef struct HapticsWatch {
+	int fd; // inotify descriptor, watching the directory of the bank
+	const char *name; // bank file name within its directory
+	char path[]; // bank file
+} HapticsWatch;
+
+#define HAPTICS_MAX_SEQUENCES 32 // default sequence table size
+#define HAPTICS_MAX_SEQUENCE_STEPS 256 // default step pool size, shared by all sequences
+#define HAPTICS_MAX_TIMELINES 64 // default number of sequences playing at once
+#define HAPTICS_MAX_MIXER_VOICES 32 // default number of mixed effects per player
+
+// Registered sequence of effect steps
+typedef struct HapticsSequence {
+	int first; // first step in the step pool
+	int count; // number of steps
+} HapticsSequence;
+
+// Sequence playing on a player
+typedef struct HapticsTimeline {
+	int player;
+	int sequence;
+	int step; // next step to run
+	Uint32 iterations; // remaining plays of the sequence, SDL_HAPTIC_INFINITY to repeat until stopped
+	Uint32 next; // tick count at which the next step runs
+} HapticsTimeline;
+
+// Backends
+// - Null backend, opening every joystick and doing nothing
+static char Haptics_null_device; // device handle of every null device
+
+static int Haptics_null_init(void *data){
+	return 0;
+}
+
+static void *Haptics_null_open(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info){
+	info->effects = 0;
+	info->playing = 0;
+	info->features = ~0u;
+	return &Haptics_null_device;
+}
+
+static void Haptics_null_close(void *data, void *device){
+}
+
+static int Haptics_null_new_effect(void *data, void *device, union SDL_HapticEffect *effect){
+	return 0;
+}
+
+static int Haptics_null_update_effect(void *data, void *device, int effect, union SDL_HapticEffect *definition){
+	return 0;
+}
+
+static void Haptics_null_destroy_effect(void *data, void *device, int effect){
+}
+
+static int Haptics_null_run_effect(void *data, void *device, int effect, Uint32 iterations){
+	return 0;
+}
+
+static int Haptics_null_call(void *data, void *device){
+	return 0;
+}
+
+static int Haptics_null_effect_call(void *data, void *device, int effect){
+	return 0;
+}
+
+static int Haptics_null_set_gain(void *data, void *device, int gain){
+	return 0;
+}
+
+static int Haptics_null_rumble(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms){
+	return 0;
+}
+
+#define HAPTICS_NULL_BACKEND { NULL, Haptics_null_init, Haptics_null_open, Haptics_null_close, Haptics_null_new_effect, Haptics_null_update_effect, Haptics_null_destroy_effect, Haptics_null_run_effect, Haptics_null_effect_call, Haptics_null_call, Haptics_null_call, Haptics_null_call, Haptics_null_set_gain, Haptics_null_rumble }
+
+static const HapticsBackend haptics_null_backend = HAPTICS_NULL_BACKEND;
+
+const HapticsBackend *Haptics_null_backend(){
+	return &haptics_null_backend;
+}
+
+#ifndef HAPTICS_NO_SDL_HAPTIC
+// - SDL backend, haptic devices and rumble of joysticks without them
+static int Haptics_sdl_init(void *data){
+	return SDL_InitSubSystem(SDL_INIT_HAPTIC);
+}
+
+static void *Haptics_sdl_open(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info){
+	SDL_Haptic *device = SDL_HapticOpenFromJoystick(joystick);
+	if(device){
+		info->effects = SDL_HapticNumEffects(device);
+		info->playing = SDL_HapticNumEffectsPlaying(device);
+		info->features = SDL_HapticQuery(device);
+	}
+	return device;
+}
+
+static void Haptics_sdl_close(void *data, void *device){
+	SDL_HapticClose(device);
+}
+
+static int Haptics_sdl_new_effect(void *data, void *device, union SDL_HapticEffect *effect){
+	return SDL_HapticNewEffect(device, effect);
+}
+
+static int Haptics_sdl_update_effect(void *data, void *device, int effect, union SDL_HapticEffect *definition){
+	return SDL_HapticUpdateEffect(device, effect, definition);
+}
+
+static void Haptics_sdl_destroy_effect(void *data, void *device, int effect){
+	SDL_HapticDestroyEffect(device, effect);
+}
+
+static int Haptics_sdl_run_effect(void *data, void *device, int effect, Uint32 iterations){
+	return SDL_HapticRunEffect(device, effect, iterations);
+}
+
+static int Haptics_sdl_stop_effect(void *data, void *device, int effect){
+	return SDL_HapticStopEffect(device, effect);
+}
+
+static int Haptics_sdl_stop_all(void *data, void *device){
+	return SDL_HapticStopAll(device);
+}
+
+static int Haptics_sdl_pause(void *data, void *device){
+	return SDL_HapticPause(device);
+}
+
+static int Haptics_sdl_unpause(void *data, void *device){
+	return SDL_HapticUnpause(device);
+}
+
+static int Haptics_sdl_set_gain(void *data, void *device, int gain){
+	return SDL_HapticSetGain(device, gain);
+}
+
+static int Haptics_sdl_rumble(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms){
+	return SDL_JoystickRumble(joystick, low, high, duration_ms);
+}
+
+#define HAPTICS_DEFAULT_BACKEND { NULL, Haptics_sdl_init, Haptics_sdl_open, Haptics_sdl_close, Haptics_sdl_new_effect, Haptics_sdl_update_effect, Haptics_sdl_destroy_effect, Haptics_sdl_run_effect, Haptics_sdl_stop_effect, Haptics_sdl_stop_all, Haptics_sdl_pause, Haptics_sdl_unpause, Haptics_sdl_set_gain, Haptics_sdl_rumble }
+
+static const HapticsBackend haptics_sdl_backend = HAPTICS_DEFAULT_BACKEND;
+
+const HapticsBackend *Haptics_sdl_backend(){
+	return &haptics_sdl_backend;
+}
+#else
+// headless builds do not link the SDL haptic subsystem
+#define HAPTICS_DEFAULT_BACKEND HAPTICS_NULL_BACKEND
+#endif
+
+// - Recording backend, recording calls before passing them on
+static void Haptics_record(HapticsRecorder *recorder, HapticsBackendCall call, void *device, int effect, Uint32 value, int result){
+	if(recorder->count >= recorder->size){
+		recorder->dropped++;
+		return;
+	}
+	HapticsRecord *record = &recorder->records[recorder->count++];
+	record->call = call;
+	record->device = device;
+	record->effect = effect;
+	record->value = value;
+	record->result = result;
+}
+
+static inline const HapticsBackend *Haptics_recording_next(HapticsRecorder *recorder){
+	return recorder->next ? recorder->next : &haptics_null_backend;
+}
+
+static int Haptics_recording_init(void *data){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	return next->init(next->data);
+}
+
+static void *Haptics_recording_open(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	void *device = next->open(next->data, joystick, info);
+	Haptics_record(data, HAPTICS_CALL_OPEN, joystick, -1, info->features, device ? 0 : -1);
+	return device;
+}
+
+static void Haptics_recording_close(void *data, void *device){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	next->close(next->data, device);
+	Haptics_record(data, HAPTICS_CALL_CLOSE, device, -1, 0, 0);
+}
+
+static int Haptics_recording_new_effect(void *data, void *device, union SDL_HapticEffect *effect){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->new_effect(next->data, device, effect);
+	Haptics_record(data, HAPTICS_CALL_NEW_EFFECT, device, result, effect->type, result);
+	return result;
+}
+
+static int Haptics_recording_update_effect(void *data, void *device, int effect, union SDL_HapticEffect *definition){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->update_effect(next->data, device, effect, definition);
+	Haptics_record(data, HAPTICS_CALL_UPDATE_EFFECT, device, effect, definition->type, result);
+	return result;
+}
+
+static void Haptics_recording_destroy_effect(void *data, void *device, int effect){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	next->destroy_effect(next->data, device, effect);
+	Haptics_record(data, HAPTICS_CALL_DESTROY_EFFECT, device, effect, 0, 0);
+}
+
+static int Haptics_recording_run_effect(void *data, void *device, int effect, Uint32 iterations){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->run_effect(next->data, device, effect, iterations);
+	Haptics_record(data, HAPTICS_CALL_RUN_EFFECT, device, effect, iterations, result);
+	return result;
+}
+
+static int Haptics_recording_stop_effect(void *data, void *device, int effect){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->stop_effect(next->data, device, effect);
+	Haptics_record(data, HAPTICS_CALL_STOP_EFFECT, device, effect, 0, result);
+	return result;
+}
+
+static int Haptics_recording_stop_all(void *data, void *device){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->stop_all(next->data, device);
+	Haptics_record(data, HAPTICS_CALL_STOP_ALL, device, -1, 0, result);
+	return result;
+}
+
+static int Haptics_recording_pause(void *data, void *device){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->pause(next->data, device);
+	Haptics_record(data, HAPTICS_CALL_PAUSE, device, -1, 0, result);
+	return result;
+}
+
+static int Haptics_recording_unpause(void *data, void *device){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->unpause(next->data, device);
+	Haptics_record(data, HAPTICS_CALL_UNPAUSE, device, -1, 0, result);
+	return result;
+}
+
+static int Haptics_recording_set_gain(void *data, void *device, int gain){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->set_gain(next->data, device, gain);
+	Haptics_record(data, HAPTICS_CALL_SET_GAIN, device, -1, gain, result);
+	return result;
+}
+
+static int Haptics_recording_rumble(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms){
+	const HapticsBackend *next = Haptics_recording_next(data);
+	int result = next->rumble(next->data, joystick, low, high, duration_ms);
+	Haptics_record(data, HAPTICS_CALL_RUMBLE, joystick, -1, ((Uint32)low << 16) | high, result);
+	return result;
+}
+
+void Haptics_recording_backend(HapticsRecorder *recorder, HapticsBackend *backend){
+	HapticsBackend recording = { recorder, Haptics_recording_init, Haptics_recording_open, Haptics_recording_close, Haptics_recording_new_effect, Haptics_recording_update_effect, Haptics_recording_destroy_effect, Haptics_recording_run_effect, Haptics_recording_stop_effect, Haptics_recording_stop_all, Haptics_recording_pause, Haptics_recording_unpause, Haptics_recording_set_gain, Haptics_recording_rumble };
+	*backend = recording;
+}
+
+// Player settings, in key table order
+enum HapticsPlayerSetting {
+	HAPTICS_SETTING_ENABLED,
+	HAPTICS_SETTING_GAIN,
+	HAPTICS_PLAYER_SETTINGS
+};
+
+static const char *haptics_setting_names[HAPTICS_PLAYER_SETTINGS] = { "enabled", "gain" };
+
+#define HAPTICS_SETTING_KEY_SIZE 40
+
+// Overall settings
+
+typedef struct HapticsContext {
+	// read by triggers
+	int enabled;
+	int lazy; // upload effects to devices on first use instead of on connect
+	Uint32 *playable; // bitmap of players that are enabled and connected, triggers on other players are dropped
+	Uint32 *connected; // bitmap of players with a device or rumble joystick
+	HapticsPlayer *players; // Haptic data, indexed by player
+	int *effectHandles; // current handle of each effect slot
+	int max_players; // player table size
+	int max_effects; // effect table size
+	int device_effects; // device effect identifiers per player, the registered effects then the mixer effect
+	Uint32 clock; // effect use counter, for most recently used first uploads
+	Uint32 *effectUsed; // use clock value at the last run of each effect, on any player
+	int *effectPriorities; // voice priority of each effect
+	Uint8 *effectRetrigger; // retrigger policy of each effect
+	Uint32 *effectInterval; // minimum milliseconds between starts of each interval limited effect
+	HapticsQueue *queue; // device calls are queued for the worker thread when set
+	HapticsBatch *batch; // device calls are collected until flushed when set
+	HapticsThreads *threads; // triggers from other threads are queued when set
+	HapticsTrace *trace; // operations are traced when set
+	HapticsCapture *capture; // public calls are captured when set
+	Uint32 now; // tick count of the last update
+	int ticking; // an update has set the tick count, timelines started before it are timed from the first update
+	HapticsBackend backend; // device access functions
+
+	int mixing; // mix effects in software on devices with left/right motors
+	int hotplug; // open added controllers on the worker thread and upload their effects over several updates
+	HapticsConfig sizes; // table sizes
+	void *tables; // single allocation holding the player and effect tables, those read by triggers first
+	union SDL_HapticEffect *effectDefinitions; // Pre-Defined effects, identified by index
+	Uint32 *registered; // bitmap of registered effect slots
+	Uint32 *removed; // bitmap of removed effect slots, whose generation advances on reuse
+	int freeWord; // lowest bitmap word that may have a free slot
+	int extending; // number of extended effects waiting to restart, on any player
+	HapticsVoiceStats voiceStats;
+	HapticsSequence *sequences; // registered sequences
+	int sequenceCount;
+	HapticsStep *steps; // step pool holding the steps of all sequences
+	int stepCount;
+	HapticsTimeline *timelines; // playing sequences, packed at the start of the pool
+	int timelineCount;
+	char *settingKeys; // configuration key of each player setting
+	HapticsSetting *settings; // player settings by player and setting, with the value last loaded or saved
+	HapticsSetting *settingsBatch; // changed settings handed to a save
+	Uint64 counterFrequency; // performance counter ticks per second
+	HapticsWatch *watch; // effect bank reloaded on change when set
+#ifndef HAPTICS_NO_STATS
+	HapticsCounters *playerCounters; // effect counters of each player
+	HapticsCounters *effectCounters; // effect counters of each effect
+	unsigned int latency[HAPTICS_BACKEND_CALLS][HAPTICS_LATENCY_BUCKETS]; // backend calls by duration
+#endif
+} Haptics;
+
+// Settings of a new context
+#define HAPTICS_CONTEXT_DEFAULTS { .enabled = 1, .lazy = 0, .mixing = 0, .hotplug = 0, .playable = NULL, .connected = NULL, .queue = NULL, .batch = NULL, .threads = NULL, .sizes = {}, .max_players = 0, .max_effects = 0, .device_effects = 0, .tables = NULL, .effectDefinitions = NULL, .effectHandles = NULL, .registered = NULL, .removed = NULL, .freeWord = 0, .effectPriorities = NULL, .effectRetrigger = NULL, .effectInterval = NULL, .extending = 0, .effectUsed = NULL, .clock = 0, .voiceStats = {}, .sequences = NULL, .sequenceCount = 0, .steps = NULL, .stepCount = 0, .timelines = NULL, .timelineCount = 0, .now = 0, .ticking = 0, .players = NULL, .settingKeys = NULL, .settings = NULL, .settingsBatch = NULL, .backend = HAPTICS_DEFAULT_BACKEND, .counterFrequency = 1, .trace = NULL, .capture = NULL, .watch = NULL }
+
+// Context of threads that have not selected one
+static Haptics haptics_default = HAPTICS_CONTEXT_DEFAULTS;
+
+// Context the calls of each thread act on
+static _Thread_local Haptics *haptics_context = &haptics_default;
+#define haptics (*haptics_context)
+
+// Count an effect event for a player and effect index, effect -1 when unknown
+#ifndef HAPTICS_NO_STATS
+#define HAPTICS_COUNT(player, effect, counter) do { haptics.playerCounters[player].counter++; if((effect) >= 0){ haptics.effectCounters[effect].counter++; } } while(0)
+#else
+#define HAPTICS_COUNT(player, effect, counter) do {} while(0)
+#endif
+
+static void Haptics_player_apply_gain(int player);
+static void Haptics_player_clear_voices(int player);
+static void Haptics_player_clear_timelines(int player);
+static void Haptics_player_clear_mix(int player);
+static void Haptics_player_resume(int player);
+static int Haptics_player_collect_open(int player);
+
+
+// Effect handles
+// - Effect index for a handle, -1 for stale or invalid handles
+static inline int Haptics_effect_index(int effect){
+	int index = effect & HAPTICS_HANDLE_INDEX_MASK;
+	if((index >= haptics.max_effects) || (haptics.effectHandles[index] != effect)){
+		return -1;
+	}
+	return index;
+}
+
+// - Lowest set bit of a non-zero bitmap word
+static inline int Haptics_lowest_bit(Uint32 bits){
+#if defined(__GNUC__)
+	return __builtin_ctz(bits);
+#else
+	int bit = 0;
+	while(!(bits & 1)){
+		bits >>= 1;
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+// - Highest set bit of a non-zero value
+static inline int Haptics_highest_bit(Uint64 bits){
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(bits);
+#else
+	int bit = 0;
+	while(bits >>= 1){
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+// - Claim the lowest free effect slot, -1 when the table is full
+static int Haptics_effect_alloc(){
+	int words = (haptics.max_effects + 31) / 32;
+	for(int w = haptics.freeWord; w < words; w++){
+		Uint32 free = ~haptics.registered[w];
+		while(free){
+			int index = (w * 32) + Haptics_lowest_bit(free);
+			if(index >= haptics.max_effects){
+				break;
+			}
+			haptics.registered[w] |= (1u << (index % 32));
+			free &= ~(1u << (index % 32));
+			// definitions set directly stay in their slots
+			if(haptics.effectDefinitions[index].type){
+				continue;
+			}
+			haptics.freeWord = w;
+			if(haptics.removed[w] & (1u << (index % 32))){
+				haptics.removed[w] &= ~(1u << (index % 32));
+				int generation = ((haptics.effectHandles[index] >> HAPTICS_HANDLE_INDEX_BITS) + 1) & HAPTICS_HANDLE_GENERATION_MASK;
+				haptics.effectHandles[index] = (generation << HAPTICS_HANDLE_INDEX_BITS) | index;
+			}
+			return index;
+		}
+	}
+	haptics.freeWord = words;
+	return -1;
+}
+
+// - Return an effect slot to the free slots
+static void Haptics_effect_free(int index){
+	haptics.registered[index / 32] &= ~(1u << (index % 32));
+	haptics.removed[index / 32] |= (1u << (index % 32));
+	if((index / 32) < haptics.freeWord){
+		haptics.freeWord = index / 32;
+	}
+}
+
+// Device commands
+// - Issue a command to its device, using and updating the given device effect identifiers
+static int Haptics_execute_call(HapticsCommand *command, int *effects){
+	HapticsBackend *backend = &haptics.backend;
+	switch(command->type){
+		case HAPTICS_COMMAND_NEW:
+			effects[command->effect] = backend->new_effect(backend->data, command->device, &command->definition);
+			return effects[command->effect];
+		case HAPTICS_COMMAND_UPDATE:
+			if(effects[command->effect] < 0){
+				return -1;
+			}
+			return backend->update_effect(backend->data, command->device, effects[command->effect], &command->definition);
+		case HAPTICS_COMMAND_DESTROY:
+			if(effects[command->effect] >= 0){
+				backend->destroy_effect(backend->data, command->device, effects[command->effect]);
+				effects[command->effect] = -1;
+			}
+			return 0;
+		case HAPTICS_COMMAND_RUN:
+			if(effects[command->effect] < 0){
+				return -1;
+			}
+			return backend->run_effect(backend->data, command->device, effects[command->effect], command->value);
+		case HAPTICS_COMMAND_STOP:
+			if(effects[command->effect] < 0){
+				return -1;
+			}
+			return backend->stop_effect(backend->data, command->device, effects[command->effect]);
+		case HAPTICS_COMMAND_STOP_ALL:
+			if(command->joystick){
+				return backend->rumble(backend->data, command->joystick, 0, 0, 0);
+			}
+			return backend->stop_all(backend->data, command->device);
+		case HAPTICS_COMMAND_PAUSE:
+			// rumble cannot be paused, the mix is pushed again on unpause
+			if(command->joystick){
+				return backend->rumble(backend->data, command->joystick, 0, 0, 0);
+			}
+			return backend->pause(backend->data, command->device);
+		case HAPTICS_COMMAND_UNPAUSE:
+			if(command->joystick){
+				return 0;
+			}
+			return backend->unpause(backend->data, command->device);
+		case HAPTICS_COMMAND_GAIN:
+			return backend->set_gain(backend->data, command->device, command->value);
+		case HAPTICS_COMMAND_CLOSE:
+			// rumble joysticks belong to the caller and are only silenced
+			if(command->joystick){
+				backend->rumble(backend->data, command->joystick, 0, 0, 0);
+			}
+			else{
+				backend->close(backend->data, command->device);
+			}
+			for(int i = 0; i < haptics.device_effects; i++){
+				effects[i] = -1;
+			}
+			return 0;
+		case HAPTICS_COMMAND_SYNC:
+			break;
+		case HAPTICS_COMMAND_RUMBLE:
+			return backend->rumble(backend->data, command->joystick, command->definition.leftright.large_magnitude, command->definition.leftright.small_magnitude, command->definition.leftright.length);
+		case HAPTICS_COMMAND_OPEN: {
+			// handed back to the game thread, which falls back to rumble when there is no device
+			HapticsOpening *opening = &haptics.players[command->player].opening;
+			memset(&opening->info, 0, sizeof(opening->info));
+			opening->device = backend->open(backend->data, command->joystick, &opening->info);
+			for(int i = 0; i < haptics.device_effects; i++){
+				effects[i] = -1;
+			}
+			atomic_store_explicit(&opening->state, HAPTICS_OPENING_DONE, memory_order_release);
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// - Backend call made by a command, -1 when it makes none
+static int Haptics_command_call(HapticsCommand *command, int *effects){
+	switch(command->type){
+		case HAPTICS_COMMAND_NEW:
+			return HAPTICS_CALL_NEW_EFFECT;
+		case HAPTICS_COMMAND_UPDATE:
+			return (effects[command->effect] >= 0) ? HAPTICS_CALL_UPDATE_EFFECT : -1;
+		case HAPTICS_COMMAND_DESTROY:
+			return (effects[command->effect] >= 0) ? HAPTICS_CALL_DESTROY_EFFECT : -1;
+		case HAPTICS_COMMAND_RUN:
+			return (effects[command->effect] >= 0) ? HAPTICS_CALL_RUN_EFFECT : -1;
+		case HAPTICS_COMMAND_STOP:
+			return (effects[command->effect] >= 0) ? HAPTICS_CALL_STOP_EFFECT : -1;
+		case HAPTICS_COMMAND_STOP_ALL:
+			return command->joystick ? HAPTICS_CALL_RUMBLE : HAPTICS_CALL_STOP_ALL;
+		case HAPTICS_COMMAND_PAUSE:
+			return command->joystick ? HAPTICS_CALL_RUMBLE : HAPTICS_CALL_PAUSE;
+		case HAPTICS_COMMAND_UNPAUSE:
+			return command->joystick ? -1 : HAPTICS_CALL_UNPAUSE;
+		case HAPTICS_COMMAND_GAIN:
+			return HAPTICS_CALL_SET_GAIN;
+		case HAPTICS_COMMAND_CLOSE:
+			return command->joystick ? HAPTICS_CALL_RUMBLE : HAPTICS_CALL_CLOSE;
+		case HAPTICS_COMMAND_SYNC:
+			break;
+		case HAPTICS_COMMAND_RUMBLE:
+			return HAPTICS_CALL_RUMBLE;
+		case HAPTICS_COMMAND_OPEN:
+			return HAPTICS_CALL_OPEN;
+	}
+	return -1;
+}
+
+#ifndef HAPTICS_NO_STATS
+// - Count a backend call in the latency histogram of its kind
+static inline void Haptics_count_latency(int call, Uint64 ticks){
+	Uint64 elapsed = (ticks * 1000000) / haptics.counterFrequency;
+	int bucket = elapsed ? (Haptics_highest_bit(elapsed) + 1) : 0;
+	if(bucket >= HAPTICS_LATENCY_BUCKETS){
+		bucket = HAPTICS_LATENCY_BUCKETS - 1;
+	}
+	haptics.latency[call][bucket]++;
+}
+#endif
+
+// Capture
+// - Write a captured call, unless it is made from within another captured call
+static void Haptics_capture_write(int op, int player, int effect, Uint32 value, const void *payload, int size){
+	HapticsCapture *capture = haptics.capture;
+	if(capture->nested || capture->failed){
+		return;
+	}
+	Uint64 now = SDL_GetPerformanceCounter();
+	HapticsCaptureRecord record;
+	record.delta_us = (Uint32)(((now - capture->last) * 1000000) / haptics.counterFrequency);
+	record.op = op;
+	record.player = player;
+	record.effect = effect;
+	record.value = value;
+	capture->last = now;
+	if((fwrite(&record, sizeof(record), 1, capture->file) != 1) || (size && (fwrite(payload, size, 1, capture->file) != 1))){
+		capture->failed = 1;
+	}
+}
+
+static inline void Haptics_capture(int op, int player, int effect, Uint32 value){
+	if(haptics.capture){
+		Haptics_capture_write(op, player, effect, value, NULL, 0);
+	}
+}
+
+static inline void Haptics_capture_definition(int op, int player, int effect, union SDL_HapticEffect *definition){
+	if(haptics.capture){
+		Haptics_capture_write(op, player, effect, 0, definition, sizeof(union SDL_HapticEffect));
+	}
+}
+
+// - Enter or leave a call whose inner public calls are part of it
+static inline void Haptics_capture_nest(int depth){
+	if(haptics.capture){
+		haptics.capture->nested += depth;
+	}
+}
+
+// Tracing
+// - Start time of a traced operation, 0 when not tracing
+static inline Uint64 Haptics_trace_begin(){
+	return haptics.trace ? SDL_GetPerformanceCounter() : 0;
+}
+
+// - Record an operation that started at start and ends now
+static void Haptics_trace_event(int name, int player, int effect, Uint64 start, Uint64 end){
+	HapticsTrace *trace = haptics.trace;
+	HapticsTraceEvent *event = &trace->events[trace->count % trace->capacity];
+	event->start = start;
+	event->duration = end - start;
+	event->name = name;
+	event->player = player;
+	event->effect = effect;
+	trace->count++;
+}
+
+static inline void Haptics_trace_end(int name, int player, int effect, Uint64 start){
+	if(haptics.trace){
+		Haptics_trace_event(name, player, effect, start, SDL_GetPerformanceCounter());
+	}
+}
+
+// - Issue a command to its device, timing the backend call
+static int Haptics_execute(HapticsCommand *command, int *effects){
+	// the trace belongs to the game thread, worker calls are left out
+	int traced = haptics.trace && !haptics.queue;
+#ifdef HAPTICS_NO_STATS
+	if(!traced){
+		return Haptics_execute_call(command, effects);
+	}
+#endif
+	int call = Haptics_command_call(command, effects);
+	if(call < 0){
+		return Haptics_execute_call(command, effects);
+	}
+	Uint64 start = SDL_GetPerformanceCounter();
+	int result = Haptics_execute_call(command, effects);
+	Uint64 end = SDL_GetPerformanceCounter();
+#ifndef HAPTICS_NO_STATS
+	Haptics_count_latency(call, end - start);
+#endif
+	if(traced){
+		Haptics_trace_event(HAPTICS_TRACE_CALLS + call, command->player, command->effect, start, end);
+	}
+	return result;
+}
+
+// - Issue a command, re-creating effects the device refuses to update
+static int Haptics_issue(HapticsCommand *command, int *effects){
+	int result = Haptics_execute(command, effects);
+	if((result < 0) && (command->type == HAPTICS_COMMAND_UPDATE) && (effects[command->effect] >= 0)){
+		HapticsCommand retry = *command;
+		retry.type = HAPTICS_COMMAND_DESTROY;
+		Haptics_execute(&retry, effects);
+		retry.type = HAPTICS_COMMAND_NEW;
+		Haptics_execute(&retry, effects);
+	}
+	return result;
+}
+
+// - Queue a command for the worker thread
+static int Haptics_queue_push(HapticsQueue *queue, HapticsCommand *command){
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	while((head - atomic_load_explicit(&queue->tail, memory_order_acquire)) >= HAPTICS_QUEUE_SIZE){
+		// a dropped trigger is only a missed rumble, anything else has to wait for room
+		if(command->type == HAPTICS_COMMAND_RUN){
+			queue->overflows++;
+			return -1;
+		}
+		// the worker may be asleep on commands it was not woken for
+		if(queue->held){
+			queue->held = 0;
+			SDL_SemPost(queue->pending);
+		}
+		queue->stalls++;
+		SDL_Delay(1);
+	}
+
+	queue->commands[head & (HAPTICS_QUEUE_SIZE - 1)] = *command;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	queue->queued++;
+	if(queue->hold){
+		queue->held++;
+	}
+	else{
+		SDL_SemPost(queue->pending);
+	}
+
+	// the worker owns the real device effect identifier, the effect index marks it as uploaded
+	if(command->type == HAPTICS_COMMAND_NEW){
+		return command->effect;
+	}
+	return 0;
+}
+
+// - Run all queued commands, on the worker thread
+static void Haptics_queue_drain(HapticsQueue *queue){
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	while(tail != head){
+		HapticsCommand *command = &queue->commands[tail & (HAPTICS_QUEUE_SIZE - 1)];
+		if(command->type == HAPTICS_COMMAND_SYNC){
+			SDL_SemPost(queue->synced);
+		}
+		else if(Haptics_issue(command, queue->effect + (command->player * haptics.device_effects)) < 0){
+			atomic_fetch_add_explicit(&queue->failures, 1, memory_order_relaxed);
+		}
+		tail++;
+		atomic_store_explicit(&queue->tail, tail, memory_order_release);
+	}
+}
+
+static int SDLCALL Haptics_worker(void *data){
+	HapticsQueue *queue = data;
+	haptics_context = queue->context;
+	while(!atomic_load(&queue->quit)){
+		SDL_SemWait(queue->pending);
+		Haptics_queue_drain(queue);
+	}
+	return 0;
+}
+
+// - Wake the worker once for the commands of a group of players
+static inline void Haptics_queue_hold(int depth){
+	HapticsQueue *queue = haptics.queue;
+	if(!queue){
+		return;
+	}
+	queue->hold += depth;
+	if(!queue->hold && queue->held){
+		queue->held = 0;
+		SDL_SemPost(queue->pending);
+	}
+}
+
+// - Issue a command now, or hand it to the worker thread in async mode
+static int Haptics_dispatch(HapticsCommand *command){
+	if(haptics.queue){
+		return Haptics_queue_push(haptics.queue, command);
+	}
+	return Haptics_execute(command, haptics.players[command->player].effect);
+}
+
+// - Collect a command for the next flush, merging it with earlier commands for the same effect
+static int Haptics_batch_add(HapticsBatch *batch, HapticsCommand *command){
+	int *pending = NULL;
+	int *other = NULL;
+	int at = (command->player * haptics.device_effects) + command->effect;
+	switch(command->type){
+		case HAPTICS_COMMAND_RUN:
+		case HAPTICS_COMMAND_STOP:
+			pending = &batch->trigger[at];
+			other = &batch->update[at];
+			break;
+		case HAPTICS_COMMAND_UPDATE:
+			pending = &batch->update[at];
+			other = &batch->trigger[at];
+			break;
+		default:
+			// other device calls keep their order with everything batched before them
+			Haptics_flush();
+			return Haptics_dispatch(command);
+	}
+	batch->stats.queued++;
+
+	// merging into a command queued before a pending update or trigger of the same effect would reorder them
+	if(*pending && (*other < *pending)){
+		HapticsCommand *earlier = &batch->commands[*pending - 1];
+		// a stop cancels a run from the same frame, anything else replaces the earlier command
+		if((command->type == HAPTICS_COMMAND_STOP) && (earlier->type == HAPTICS_COMMAND_RUN)){
+			batch->stats.cancelled++;
+		}
+		else{
+			batch->stats.coalesced++;
+		}
+		earlier->type = command->type;
+		earlier->value = command->value;
+		if(command->type == HAPTICS_COMMAND_UPDATE){
+			earlier->definition = command->definition;
+		}
+		return 0;
+	}
+
+	if(batch->count >= HAPTICS_BATCH_SIZE){
+		Haptics_flush();
+	}
+	batch->commands[batch->count] = *command;
+	*pending = ++batch->count;
+	return 0;
+}
+
+// - Issue a command, or collect it for the next flush in batched mode
+static int Haptics_command(HapticsCommand *command){
+	if(haptics.batch){
+		return Haptics_batch_add(haptics.batch, command);
+	}
+	return Haptics_dispatch(command);
+}
+
+static int Haptics_device_call(HapticsCommandType type, int player, int effect, Uint32 value){
+	HapticsCommand command;
+	command.type = type;
+	command.player = player;
+	command.effect = effect;
+	command.device = haptics.players[player].device;
+	command.joystick = haptics.players[player].rumble;
+	command.value = value;
+	return Haptics_command(&command);
+}
+
+static int Haptics_device_upload(HapticsCommandType type, int player, int effect, union SDL_HapticEffect *definition){
+	HapticsCommand command;
+	command.type = type;
+	command.player = player;
+	command.effect = effect;
+	command.device = haptics.players[player].device;
+	command.joystick = haptics.players[player].rumble;
+	command.value = 0;
+	command.definition = *definition;
+	return Haptics_command(&command);
+}
+
+// - Player is in the player table, which is empty until the haptics system is initialized
+static inline int Haptics_player_valid(int player){
+	return (unsigned int)player < (unsigned int)haptics.max_players;
+}
+
+// - Player has a haptic device or a rumble joystick
+static inline int Haptics_player_connected(int player){
+	return haptics.players[player].device || haptics.players[player].rumble;
+}
+
+// - Keep the player bitmaps in step with the enabled settings and the player device
+static inline void Haptics_player_refresh(int player){
+	Uint32 bit = 1u << (player % 32);
+	if(Haptics_player_connected(player)){
+		haptics.connected[player / 32] |= bit;
+	}
+	else{
+		haptics.connected[player / 32] &= ~bit;
+	}
+	if(haptics.enabled && haptics.players[player].enabled && Haptics_player_connected(player)){
+		haptics.playable[player / 32] |= bit;
+	}
+	else{
+		haptics.playable[player / 32] &= ~bit;
+	}
+}
+
+static void Haptics_players_refresh(){
+	for(int p = 0; p < haptics.max_players; p++){
+		Haptics_player_refresh(p);
+	}
+}
+
+
+// Triggers from other threads
+// - Read the current effect table snapshot, to be released before the trigger returns
+static inline HapticsSnapshot *Haptics_snapshot_acquire(HapticsThreads *threads, unsigned int *parity){
+	*parity = atomic_load(&threads->epoch) & 1;
+	atomic_fetch_add(&threads->readers[*parity], 1);
+	return atomic_load(&threads->snapshot);
+}
+
+static inline void Haptics_snapshot_release(HapticsThreads *threads, unsigned int parity){
+	atomic_fetch_sub(&threads->readers[parity], 1);
+}
+
+// - Wait until no trigger can still be reading a replaced snapshot
+static void Haptics_snapshot_synchronize(HapticsThreads *threads){
+	// readers that joined before the first flip drain from one count, those racing it from the other
+	for(int phase = 0; phase < 2; phase++){
+		unsigned int parity = atomic_fetch_add(&threads->epoch, 1) & 1;
+		// a reader is only a few loads long, unless its thread was descheduled while reading
+		for(int spins = 0; atomic_load(&threads->readers[parity]); spins++){
+			if(spins >= HAPTICS_SYNCHRONIZE_SPINS){
+				SDL_Delay(0);
+			}
+		}
+	}
+}
+
+// - Publish a copy of the effect table, freeing the replaced copy once triggers are done with it
+static void Haptics_publish(){
+	HapticsThreads *threads = haptics.threads;
+	if(!threads){
+		return;
+	}
+	if(threads->hold){
+		threads->dirty = 1;
+		return;
+	}
+	threads->dirty = 0;
+	int max_effects = haptics.max_effects;
+	HapticsSnapshot *snapshot = malloc(sizeof(HapticsSnapshot) + ((sizeof(union SDL_HapticEffect) + sizeof(int)) * max_effects));
+	if(!snapshot){
+		// triggers keep checking against the stale table, the owner checks again when it runs them
+		return;
+	}
+	snapshot->max_effects = max_effects;
+	snapshot->handles = (int *)(snapshot->definitions + max_effects);
+	memcpy(snapshot->definitions, haptics.effectDefinitions, sizeof(union SDL_HapticEffect) * max_effects);
+	memcpy(snapshot->handles, haptics.effectHandles, sizeof(int) * max_effects);
+
+	HapticsSnapshot *replaced = atomic_exchange(&threads->snapshot, snapshot);
+	if(replaced){
+		Haptics_snapshot_synchronize(threads);
+		free(replaced);
+	}
+}
+
+// - Defer publishing while making many changes, publishing once when done
+static inline void Haptics_publish_hold(int depth){
+	if(!haptics.threads){
+		return;
+	}
+	haptics.threads->hold += depth;
+	if(!haptics.threads->hold && haptics.threads->dirty){
+		Haptics_publish();
+	}
+}
+
+// - Trigger is made from another thread than the one calling Haptics_update
+static inline int Haptics_trigger_foreign(){
+	return haptics.threads && (SDL_ThreadID() != haptics.threads->owner);
+}
+
+// - Queue a trigger from another thread, without locking
+static void Haptics_trigger_push(int player, int effect, Uint32 iterations){
+	HapticsThreads *threads = haptics.threads;
+	// handles are checked against the snapshot so stale triggers never take a ring slot
+	unsigned int parity;
+	HapticsSnapshot *snapshot = Haptics_snapshot_acquire(threads, &parity);
+	int index = effect & HAPTICS_HANDLE_INDEX_MASK;
+	int valid = snapshot && (player >= 0) && (player < haptics.max_players) && (effect >= 0) && (index < snapshot->max_effects) && (snapshot->handles[index] == effect) && snapshot->definitions[index].type;
+	Haptics_snapshot_release(threads, parity);
+	if(!valid){
+		atomic_fetch_add_explicit(&threads->rejected, 1, memory_order_relaxed);
+		return;
+	}
+
+	// claim a slot, a bounded ring whose slots carry the position they are ready for
+	unsigned int position = atomic_load_explicit(&threads->head, memory_order_relaxed);
+	HapticsTrigger *trigger;
+	for(;;){
+		trigger = &threads->triggers[position & (HAPTICS_TRIGGER_QUEUE_SIZE - 1)];
+		int ahead = (int)(atomic_load_explicit(&trigger->sequence, memory_order_acquire) - position);
+		if(ahead == 0){
+			if(atomic_compare_exchange_weak_explicit(&threads->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)){
+				break;
+			}
+		}
+		else if(ahead < 0){
+			// a dropped trigger is only a missed rumble
+			atomic_fetch_add_explicit(&threads->overflows, 1, memory_order_relaxed);
+			return;
+		}
+		else{
+			position = atomic_load_explicit(&threads->head, memory_order_relaxed);
+		}
+	}
+	trigger->player = player;
+	trigger->effect = effect;
+	trigger->iterations = iterations;
+	atomic_store_explicit(&trigger->sequence, position + 1, memory_order_release);
+}
+
+// - Run the triggers queued by other threads, on the owner thread
+static void Haptics_trigger_drain(HapticsThreads *threads){
+	for(;;){
+		HapticsTrigger *trigger = &threads->triggers[threads->tail & (HAPTICS_TRIGGER_QUEUE_SIZE - 1)];
+		if(atomic_load_explicit(&trigger->sequence, memory_order_acquire) != (threads->tail + 1)){
+			return;
+		}
+		int player = trigger->player;
+		int effect = trigger->effect;
+		Uint32 iterations = trigger->iterations;
+		atomic_store_explicit(&trigger->sequence, threads->tail + HAPTICS_TRIGGER_QUEUE_SIZE, memory_order_release);
+		threads->tail++;
+		threads->stats.drained++;
+		if(iterations){
+			Haptics_player_run_effect(player, effect, iterations);
+		}
+		else{
+			Haptics_player_stop_effect(player, effect);
+		}
+	}
+}
+
+
+// System management
+// - Contexts
+HapticsContext *Haptics_create_context(){
+	Haptics *context = malloc(sizeof(Haptics));
+	if(!context){
+		return NULL;
+	}
+	*context = (Haptics)HAPTICS_CONTEXT_DEFAULTS;
+	return context;
+}
+
+void Haptics_destroy_context(HapticsContext *context){
+	if(!context || (context == &haptics_default)){
+		return;
+	}
+	Haptics *previous = haptics_context;
+	haptics_context = context;
+	Haptics_stop_capture();
+	Haptics_unwatch_bank();
+	Haptics_close();
+	Haptics_set_tracing(0);
+	free(haptics.tables);
+	haptics_context = (previous == context) ? &haptics_default : previous;
+	free(context);
+}
+
+void Haptics_set_context(HapticsContext *context){
+	haptics_context = context ? context : &haptics_default;
+}
+
+HapticsContext *Haptics_get_context(){
+	return haptics_context;
+}
+
+// - Init
+int Haptics_init(){
+	return Haptics_init_with_config(NULL);
+}
+
+// Reserve room for a table in the shared table allocation, returning its offset.
+static size_t Haptics_tables_reserve(size_t *size, size_t count, size_t element){
+	size_t offset = *size;
+	size_t align = _Alignof(max_align_t);
+	*size += ((count * element) + align - 1) & ~(align - 1);
+	return offset;
+}
+
+int Haptics_init_with_config(const HapticsConfig *config){
+	HapticsConfig sizes = { HAPTICS_MAX_PLAYERS, HAPTICS_MAX_EFFECTS, HAPTICS_MAX_SEQUENCES, HAPTICS_MAX_SEQUENCE_STEPS, HAPTICS_MAX_TIMELINES, HAPTICS_MAX_MIXER_VOICES };
+	if(config && (config->max_players > 0)){
+		sizes.max_players = config->max_players;
+	}
+	if(config && (config->max_effects > 0)){
+		sizes.max_effects = config->max_effects;
+	}
+	if(config && (config->max_sequences > 0)){
+		sizes.max_sequences = config->max_sequences;
+	}
+	if(config && (config->max_sequence_steps > 0)){
+		sizes.max_sequence_steps = config->max_sequence_steps;
+	}
+	if(config && (config->max_timelines > 0)){
+		sizes.max_timelines = config->max_timelines;
+	}
+	if(config && (config->max_mixer_voices > 0)){
+		sizes.max_mixer_voices = config->max_mixer_voices;
+	}
+	// effect indexes must fit in handles
+	if(sizes.max_effects > HAPTICS_HANDLE_INDEX_MASK){
+		return 0;
+	}
+	int max_players = sizes.max_players;
+	int max_effects = sizes.max_effects;
+	int max_voices = sizes.max_mixer_voices;
+
+	// tables are kept across re-initialization unless their size changes
+	if(!haptics.tables || memcmp(&sizes, &haptics.sizes, sizeof(HapticsConfig))){
+		// tables are sized by the queue and batch, which must be resized with them
+		if(haptics.queue || haptics.batch){
+			return 0;
+		}
+
+		// all tables share one allocation
+		size_t size = 0;
+		// tables read by triggers come first, the large definition tables after them
+		size_t playable_at = Haptics_tables_reserve(&size, (max_players + 31) / 32, sizeof(Uint32));
+		size_t connected_at = Haptics_tables_reserve(&size, (max_players + 31) / 32, sizeof(Uint32));
+		// each player starts a cache line
+		size = (size + HAPTICS_CACHE_LINE - 1) & ~(size_t)(HAPTICS_CACHE_LINE - 1);
+		size_t players_at = Haptics_tables_reserve(&size, max_players, sizeof(HapticsPlayer));
+		size_t handles_at = Haptics_tables_reserve(&size, max_effects, sizeof(int));
+		size_t effects_at = Haptics_tables_reserve(&size, max_players * (max_effects + 1), sizeof(int));
+		size_t used_at = Haptics_tables_reserve(&size, max_players * max_effects, sizeof(Uint32));
+		size_t until_at = Haptics_tables_reserve(&size, max_players * max_effects, sizeof(Uint32));
+		size_t effect_used_at = Haptics_tables_reserve(&size, max_effects, sizeof(Uint32));
+		size_t priorities_at = Haptics_tables_reserve(&size, max_effects, sizeof(int));
+		size_t retrigger_policies_at = Haptics_tables_reserve(&size, max_effects, sizeof(Uint8));
+		size_t intervals_at = Haptics_tables_reserve(&size, max_effects, sizeof(Uint32));
+		size_t retrigger_at = Haptics_tables_reserve(&size, max_players * max_effects, sizeof(Uint32));
+		size_t extending_at = Haptics_tables_reserve(&size, max_players * ((max_effects + 31) / 32), sizeof(Uint32));
+		size_t registered_at = Haptics_tables_reserve(&size, (max_effects + 31) / 32, sizeof(Uint32));
+		size_t removed_at = Haptics_tables_reserve(&size, (max_effects + 31) / 32, sizeof(Uint32));
+		size_t definitions_at = Haptics_tables_reserve(&size, max_effects, sizeof(union SDL_HapticEffect));
+		size_t scaled_at = Haptics_tables_reserve(&size, max_players * max_effects, sizeof(union SDL_HapticEffect));
+		size_t altered_at = Haptics_tables_reserve(&size, max_players * max_effects, sizeof(Uint8));
+		size_t sequences_at = Haptics_tables_reserve(&size, sizes.max_sequences, sizeof(HapticsSequence));
+		size_t steps_at = Haptics_tables_reserve(&size, sizes.max_sequence_steps, sizeof(HapticsStep));
+		size_t timelines_at = Haptics_tables_reserve(&size, sizes.max_timelines, sizeof(HapticsTimeline));
+		size_t lanes_at = Haptics_tables_reserve(&size, max_players * HAPTICS_MIXER_LANES * max_voices, sizeof(float));
+		size_t voice_effects_at = Haptics_tables_reserve(&size, max_players * max_voices, sizeof(int));
+		size_t voice_starts_at = Haptics_tables_reserve(&size, max_players * max_voices, sizeof(Uint32));
+		size_t keys_at = Haptics_tables_reserve(&size, max_players * HAPTICS_PLAYER_SETTINGS, HAPTICS_SETTING_KEY_SIZE);
+		size_t settings_at = Haptics_tables_reserve(&size, max_players * HAPTICS_PLAYER_SETTINGS, sizeof(HapticsSetting));
+		size_t settings_batch_at = Haptics_tables_reserve(&size, max_players * HAPTICS_PLAYER_SETTINGS, sizeof(HapticsSetting));
+#ifndef HAPTICS_NO_STATS
+		size_t player_counters_at = Haptics_tables_reserve(&size, max_players, sizeof(HapticsCounters));
+		size_t effect_counters_at = Haptics_tables_reserve(&size, max_effects, sizeof(HapticsCounters));
+#endif
+		// calloc only aligns to max_align_t, the tables start at the first cache line boundary in the allocation
+		char *allocation = calloc(1, size + HAPTICS_CACHE_LINE - 1);
+		if(!allocation){
+			return 0;
+		}
+		free(haptics.tables);
+		haptics.tables = allocation;
+		char *tables = allocation + ((HAPTICS_CACHE_LINE - ((uintptr_t)allocation % HAPTICS_CACHE_LINE)) % HAPTICS_CACHE_LINE);
+		haptics.sizes = sizes;
+		haptics.max_players = max_players;
+		haptics.max_effects = max_effects;
+		haptics.device_effects = max_effects + 1;
+
+		haptics.playable = (Uint32 *)(tables + playable_at);
+		haptics.connected = (Uint32 *)(tables + connected_at);
+		haptics.effectDefinitions = (union SDL_HapticEffect *)(tables + definitions_at);
+		haptics.players = (HapticsPlayer *)(tables + players_at);
+		haptics.effectHandles = (int *)(tables + handles_at);
+		haptics.effectPriorities = (int *)(tables + priorities_at);
+		haptics.effectRetrigger = (Uint8 *)(tables + retrigger_policies_at);
+		haptics.effectInterval = (Uint32 *)(tables + intervals_at);
+		haptics.extending = 0;
+		haptics.effectUsed = (Uint32 *)(tables + effect_used_at);
+		haptics.clock = 0;
+		haptics.registered = (Uint32 *)(tables + registered_at);
+		haptics.removed = (Uint32 *)(tables + removed_at);
+		haptics.freeWord = 0;
+		for(int i = 0; i < max_effects; i++){
+			haptics.effectHandles[i] = i;
+		}
+		for(int p = 0; p < max_players; p++){
+			haptics.players[p].effect = (int *)(tables + effects_at) + (p * (max_effects + 1));
+			haptics.players[p].used = (Uint32 *)(tables + used_at) + (p * max_effects);
+			haptics.players[p].scaledDefinitions = (union SDL_HapticEffect *)(tables + scaled_at) + (p * max_effects);
+			haptics.players[p].until = (Uint32 *)(tables + until_at) + (p * max_effects);
+			haptics.players[p].altered = (Uint8 *)(tables + altered_at) + (p * max_effects);
+			haptics.players[p].retrigger = (Uint32 *)(tables + retrigger_at) + (p * max_effects);
+			haptics.players[p].extending = (Uint32 *)(tables + extending_at) + (p * ((max_effects + 31) / 32));
+
+			HapticsMixer *mixer = &haptics.players[p].mixer;
+			float *lanes = (float *)(tables + lanes_at) + (p * HAPTICS_MIXER_LANES * max_voices);
+			mixer->effect = (int *)(tables + voice_effects_at) + (p * max_voices);
+			mixer->start = (Uint32 *)(tables + voice_starts_at) + (p * max_voices);
+			mixer->length = lanes;
+			mixer->attack_rate = lanes + max_voices;
+			mixer->attack_level = lanes + (2 * max_voices);
+			mixer->fade_rate = lanes + (3 * max_voices);
+			mixer->fade_level = lanes + (4 * max_voices);
+			mixer->period_rate = lanes + (5 * max_voices);
+			mixer->wave_offset = lanes + (6 * max_voices);
+			mixer->wave_slope = lanes + (7 * max_voices);
+			mixer->wave_peak = lanes + (8 * max_voices);
+			mixer->base = lanes + (9 * max_voices);
+			mixer->ramp = lanes + (10 * max_voices);
+			mixer->large = lanes + (11 * max_voices);
+			mixer->small = lanes + (12 * max_voices);
+		}
+		haptics.sequences = (HapticsSequence *)(tables + sequences_at);
+		haptics.sequenceCount = 0;
+		haptics.steps = (HapticsStep *)(tables + steps_at);
+		haptics.stepCount = 0;
+		haptics.timelines = (HapticsTimeline *)(tables + timelines_at);
+		haptics.timelineCount = 0;
+
+		// configuration keys are built once, settings are not known to be saved yet
+		haptics.settingKeys = tables + keys_at;
+		haptics.settings = (HapticsSetting *)(tables + settings_at);
+		haptics.settingsBatch = (HapticsSetting *)(tables + settings_batch_at);
+		for(int i = 0; i < (max_players * HAPTICS_PLAYER_SETTINGS); i++){
+			char *key = haptics.settingKeys + (i * HAPTICS_SETTING_KEY_SIZE);
+			snprintf(key, HAPTICS_SETTING_KEY_SIZE, "haptics_player_%d_%s", i / HAPTICS_PLAYER_SETTINGS, haptics_setting_names[i % HAPTICS_PLAYER_SETTINGS]);
+			haptics.settings[i].key = key;
+		}
+#ifndef HAPTICS_NO_STATS
+		haptics.playerCounters = (HapticsCounters *)(tables + player_counters_at);
+		haptics.effectCounters = (HapticsCounters *)(tables + effect_counters_at);
+#endif
+	}
+	haptics.voiceStats = (HapticsVoiceStats){};
+	haptics.counterFrequency = SDL_GetPerformanceFrequency();
+#ifndef HAPTICS_NO_STATS
+	Haptics_reset_stats();
+#endif
+
+	for(int p = 0; p < max_players; p++){
+		haptics.players[p].gain = HAPTICS_MAX_GAIN;
+		for(int i = 0; i < haptics.device_effects; i++){
+			haptics.players[p].effect[i] = -1;
+		}
+	}
+	Haptics_players_refresh();
+	Haptics_publish();
+
+	// the tables are set up either way, so calls after a failed init find no devices
+	if(haptics.backend.init(haptics.backend.data) != 0){
+		return 0;
+	}
+	return 1;
+}
+
+// - Pause all
+void Haptics_pause_all(){
+	Haptics_capture(HAPTICS_CAPTURE_PAUSE_ALL, -1, -1, 0);
+	for(int i = 0; i < haptics.max_players; i++){
+		if(Haptics_player_connected(i)){
+			Haptics_device_call(HAPTICS_COMMAND_PAUSE, i, 0, 0);
+			haptics.players[i].paused = 1;
+		}
+	}
+}
+
+void Haptics_unpause_all(){
+	Haptics_capture(HAPTICS_CAPTURE_UNPAUSE_ALL, -1, -1, 0);
+	for(int i = 0; i < haptics.max_players; i++){
+		if(Haptics_player_connected(i)){
+			Haptics_device_call(HAPTICS_COMMAND_UNPAUSE, i, 0, 0);
+			Haptics_player_resume(i);
+		}
+	}
+}
+
+void Haptics_player_pause_all(int player){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_PAUSE_ALL, player, -1, 0);
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	Haptics_device_call(HAPTICS_COMMAND_PAUSE, player, 0, 0);
+	haptics.players[player].paused = 1;
+}
+
+void Haptics_player_unpause_all(int player){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_UNPAUSE_ALL, player, -1, 0);
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	Haptics_device_call(HAPTICS_COMMAND_UNPAUSE, player, 0, 0);
+	Haptics_player_resume(player);
+}
+
+// - Stop all
+void Haptics_stop_all(){
+	Haptics_capture(HAPTICS_CAPTURE_STOP_ALL, -1, -1, 0);
+	haptics.timelineCount = 0;
+	for(int i = 0; i < haptics.max_players; i++){
+		if(Haptics_player_connected(i)){
+			Haptics_device_call(HAPTICS_COMMAND_STOP_ALL, i, 0, 0);
+			Haptics_player_clear_voices(i);
+			Haptics_player_clear_mix(i);
+		}
+	}
+}
+
+void Haptics_player_stop_all(int player){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_STOP_ALL, player, -1, 0);
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	Haptics_player_clear_timelines(player);
+	Haptics_device_call(HAPTICS_COMMAND_STOP_ALL, player, 0, 0);
+	Haptics_player_clear_voices(player);
+	Haptics_player_clear_mix(player);
+}
+
+// - Cleanup
+void Haptics_close(){
+	Haptics_capture(HAPTICS_CAPTURE_CLOSE_ALL, -1, -1, 0);
+	// background opens complete first, so their devices are closed too and no later update attaches them
+	Haptics_sync();
+	Haptics_capture_nest(1);
+	for(int i = 0; i < haptics.max_players; i++){
+		Haptics_player_collect_open(i);
+	}
+	Haptics_capture_nest(-1);
+	for(int i = 0; i < haptics.max_players; i++){
+		haptics.players[i].uploading = 0;
+		if(Haptics_player_connected(i)){
+			Haptics_device_call(HAPTICS_COMMAND_STOP_ALL, i, 0, 0);
+			Haptics_device_call(HAPTICS_COMMAND_CLOSE, i, 0, 0);
+			haptics.players[i].device = NULL;
+			haptics.players[i].rumble = NULL;
+		}
+	}
+	Haptics_players_refresh();
+
+	haptics.timelineCount = 0;
+
+	// issue collected and queued device calls and stop the worker thread
+	Haptics_set_batched(0);
+	Haptics_set_async(0);
+	Haptics_set_threaded(0);
+}
+
+// - Change settings
+void Haptics_set_enabled(int value){
+	Haptics_capture(HAPTICS_CAPTURE_SET_ENABLED, -1, -1, value);
+	haptics.enabled = value;
+	Haptics_players_refresh();
+	// if haptics are disabled, make sure that they are stopped.
+	if(!value){
+		Haptics_capture_nest(1);
+		Haptics_stop_all();
+		Haptics_capture_nest(-1);
+	}
+}
+
+void Haptics_player_set_enabled(int player, int value){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_SET_ENABLED, player, -1, value);
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	haptics.players[player].enabled = value;
+	Haptics_player_refresh(player);
+	// if haptics are disabled, make sure that they are stopped.
+	if(!value){
+		Haptics_capture_nest(1);
+		Haptics_player_stop_all(player);
+		Haptics_capture_nest(-1);
+	}
+}
+
+void Haptics_player_set_gain(int player, int value){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_SET_GAIN, player, -1, value);
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	if(value < 0){
+		value = 0;
+	}
+	if(value > HAPTICS_MAX_GAIN){
+		value = HAPTICS_MAX_GAIN;
+	}
+	if(haptics.players[player].gain == value){
+		return;
+	}
+	haptics.players[player].gain = value;
+
+	if(haptics.players[player].device){
+		Haptics_player_apply_gain(player);
+	}
+}
+
+void Haptics_set_lazy_upload(int value){
+	Haptics_capture(HAPTICS_CAPTURE_SET_LAZY_UPLOAD, -1, -1, value);
+	haptics.lazy = value;
+}
+
+void Haptics_set_mixing(int value){
+	Haptics_capture(HAPTICS_CAPTURE_SET_MIXING, -1, -1, value);
+	haptics.mixing = value;
+}
+
+void Haptics_set_background_hotplug(int value){
+	Haptics_capture(HAPTICS_CAPTURE_SET_BACKGROUND_HOTPLUG, -1, -1, value);
+	haptics.hotplug = value;
+}
+
+void Haptics_set_backend(const HapticsBackend *backend){
+	static const HapticsBackend default_backend = HAPTICS_DEFAULT_BACKEND;
+	// the worker must not be in the middle of a backend call
+	Haptics_sync();
+	haptics.backend = backend ? *backend : default_backend;
+}
+
+int Haptics_set_async(int value){
+	if(value && !haptics.queue){
+		HapticsQueue *queue = calloc(1, sizeof(HapticsQueue) + (sizeof(int) * haptics.max_players * haptics.device_effects));
+		if(!queue){
+			return 0;
+		}
+		queue->effect = (int *)(queue + 1);
+		queue->context = haptics_context;
+		// the worker takes over the identifiers of effects already on devices
+		for(int p = 0; p < haptics.max_players; p++){
+			for(int i = 0; i < haptics.device_effects; i++){
+				queue->effect[(p * haptics.device_effects) + i] = haptics.players[p].effect[i];
+			}
+		}
+
+		queue->pending = SDL_CreateSemaphore(0);
+		queue->synced = SDL_CreateSemaphore(0);
+		if(queue->pending && queue->synced){
+			queue->thread = SDL_CreateThread(Haptics_worker, "haptics", queue);
+		}
+		if(!queue->thread){
+			if(queue->pending){
+				SDL_DestroySemaphore(queue->pending);
+			}
+			if(queue->synced){
+				SDL_DestroySemaphore(queue->synced);
+			}
+			free(queue);
+			return 0;
+		}
+		haptics.queue = queue;
+	}
+	else if(!value && haptics.queue){
+		HapticsQueue *queue = haptics.queue;
+		Haptics_sync();
+		atomic_store(&queue->quit, 1);
+		SDL_SemPost(queue->pending);
+		SDL_WaitThread(queue->thread, NULL);
+		haptics.queue = NULL;
+
+		// take the device effect identifiers back from the worker
+		for(int p = 0; p < haptics.max_players; p++){
+			haptics.players[p].resident = 0;
+			for(int i = 0; i < haptics.device_effects; i++){
+				haptics.players[p].effect[i] = queue->effect[(p * haptics.device_effects) + i];
+				if(haptics.players[p].effect[i] >= 0){
+					haptics.players[p].resident++;
+				}
+			}
+		}
+
+		SDL_DestroySemaphore(queue->pending);
+		SDL_DestroySemaphore(queue->synced);
+		free(queue);
+	}
+	return 1;
+}
+
+void Haptics_sync(){
+	if(!haptics.queue){
+		return;
+	}
+	HapticsCommand command;
+	command.type = HAPTICS_COMMAND_SYNC;
+	command.player = 0;
+	Haptics_queue_push(haptics.queue, &command);
+	SDL_SemWait(haptics.queue->synced);
+}
+
+int Haptics_set_batched(int value){
+	if(value && !haptics.batch){
+		size_t pending_size = sizeof(int) * haptics.max_players * haptics.device_effects;
+		HapticsBatch *batch = calloc(1, sizeof(HapticsBatch) + (2 * pending_size));
+		if(!batch){
+			return 0;
+		}
+		batch->trigger = (int *)(batch + 1);
+		batch->update = batch->trigger + (haptics.max_players * haptics.device_effects);
+		haptics.batch = batch;
+	}
+	else if(!value && haptics.batch){
+		Haptics_flush();
+		free(haptics.batch);
+		haptics.batch = NULL;
+	}
+	return 1;
+}
+
+void Haptics_flush(){
+	HapticsBatch *batch = haptics.batch;
+	if(!batch){
+		return;
+	}
+
+	for(int i = 0; i < batch->count; i++){
+		HapticsCommand *command = &batch->commands[i];
+		batch->trigger[(command->player * haptics.device_effects) + command->effect] = 0;
+		batch->update[(command->player * haptics.device_effects) + command->effect] = 0;
+		if(haptics.queue){
+			Haptics_queue_push(haptics.queue, command);
+		}
+		else{
+			Haptics_issue(command, haptics.players[command->player].effect);
+		}
+	}
+	batch->stats.flushed += batch->count;
+	batch->count = 0;
+}
+
+int Haptics_set_threaded(int value){
+	if(value && !haptics.threads){
+		HapticsThreads *threads = calloc(1, sizeof(HapticsThreads));
+		if(!threads){
+			return 0;
+		}
+		threads->owner = SDL_ThreadID();
+		for(unsigned int i = 0; i < HAPTICS_TRIGGER_QUEUE_SIZE; i++){
+			atomic_init(&threads->triggers[i].sequence, i);
+		}
+		haptics.threads = threads;
+		Haptics_publish();
+		if(!atomic_load(&threads->snapshot)){
+			free(threads);
+			haptics.threads = NULL;
+			return 0;
+		}
+	}
+	else if(!value && haptics.threads){
+		HapticsThreads *threads = haptics.threads;
+		Haptics_trigger_drain(threads);
+		haptics.threads = NULL;
+		free(atomic_load(&threads->snapshot));
+		free(threads);
+	}
+	return 1;
+}
+
+void Haptics_get_thread_stats(HapticsThreadStats *stats){
+	if(!haptics.threads){
+		*stats = (HapticsThreadStats){ 0 };
+		return;
+	}
+	*stats = haptics.threads->stats;
+	stats->overflows = atomic_load_explicit(&haptics.threads->overflows, memory_order_relaxed);
+	stats->rejected = atomic_load_explicit(&haptics.threads->rejected, memory_order_relaxed);
+}
+
+void Haptics_get_batch_stats(HapticsBatchStats *stats){
+	if(!haptics.batch){
+		*stats = (HapticsBatchStats){ 0 };
+		return;
+	}
+	*stats = haptics.batch->stats;
+}
+
+void Haptics_get_async_stats(HapticsAsyncStats *stats){
+	if(!haptics.queue){
+		*stats = (HapticsAsyncStats){ 0 };
+		return;
+	}
+	stats->queued = haptics.queue->queued;
+	stats->pending = atomic_load(&haptics.queue->head) - atomic_load(&haptics.queue->tail);
+	stats->overflows = haptics.queue->overflows;
+	stats->stalls = haptics.queue->stalls;
+	stats->failures = atomic_load(&haptics.queue->failures);
+}
+
+// - Load settings
+// - Current value of a player setting
+static inline int Haptics_setting_value(int setting){
+	HapticsPlayer *player = &haptics.players[setting / HAPTICS_PLAYER_SETTINGS];
+	return ((setting % HAPTICS_PLAYER_SETTINGS) == HAPTICS_SETTING_ENABLED) ? player->enabled : player->gain;
+}
+
+// - Apply the settings found by a load
+static void Haptics_settings_apply(){
+	for(int i = 0; i < haptics.max_players; i++){
+		HapticsSetting *settings = &haptics.settings[i * HAPTICS_PLAYER_SETTINGS];
+		if(settings[HAPTICS_SETTING_ENABLED].found){
+			Haptics_capture(HAPTICS_CAPTURE_PLAYER_LOAD_ENABLED, i, -1, settings[HAPTICS_SETTING_ENABLED].value);
+			haptics.players[i].enabled = settings[HAPTICS_SETTING_ENABLED].value;
+			Haptics_player_refresh(i);
+		}
+		if(settings[HAPTICS_SETTING_GAIN].found){
+			Haptics_player_set_gain(i, settings[HAPTICS_SETTING_GAIN].value);
+		}
+	}
+}
+
+// - Collect the settings changed since they were last loaded or saved, returning their count
+static int Haptics_settings_changed(){
+	int count = 0;
+	for(int i = 0; i < (haptics.max_players * HAPTICS_PLAYER_SETTINGS); i++){
+		int value = Haptics_setting_value(i);
+		if(!haptics.settings[i].found || (haptics.settings[i].value != value)){
+			haptics.settingsBatch[count] = haptics.settings[i];
+			haptics.settingsBatch[count].value = value;
+			count++;
+		}
+	}
+	return count;
+}
+
+// - Record a setting as saved
+static inline void Haptics_setting_saved(const HapticsSetting *saved){
+	// keys point into the key table, in settings order
+	int i = (saved->key - haptics.settingKeys) / HAPTICS_SETTING_KEY_SIZE;
+	haptics.settings[i].value = saved->value;
+	haptics.settings[i].found = 1;
+}
+
+void Haptics_settings_load(config_get_int_t get_int){
+	if(!get_int){
+		return;
+	}
+	for(int i = 0; i < (haptics.max_players * HAPTICS_PLAYER_SETTINGS); i++){
+		haptics.settings[i].found = get_int(haptics.settings[i].key, &haptics.settings[i].value) ? 1 : 0;
+	}
+	Haptics_settings_apply();
+}
+
+void Haptics_settings_load_batch(config_get_batch_t get_batch){
+	int count = haptics.max_players * HAPTICS_PLAYER_SETTINGS;
+	if(!get_batch || !count){
+		return;
+	}
+	for(int i = 0; i < count; i++){
+		haptics.settings[i].found = 0;
+	}
+	get_batch(haptics.settings, count);
+	Haptics_settings_apply();
+}
+
+void Haptics_settings_save(config_set_int_t set_int){
+	if(!set_int){
+		return;
+	}
+	int count = Haptics_settings_changed();
+	for(int i = 0; i < count; i++){
+		if(set_int(haptics.settingsBatch[i].key, haptics.settingsBatch[i].value)){
+			Haptics_setting_saved(&haptics.settingsBatch[i]);
+		}
+	}
+}
+
+void Haptics_settings_save_batch(config_set_batch_t set_batch){
+	if(!set_batch){
+		return;
+	}
+	int count = Haptics_settings_changed();
+	if(count && set_batch(haptics.settingsBatch, count)){
+		for(int i = 0; i < count; i++){
+			Haptics_setting_saved(&haptics.settingsBatch[i]);
+		}
+	}
+}
+
+// - Gain
+#define HAPTICS_SCALE(value, gain) ((value) * (gain) / HAPTICS_MAX_GAIN)
+
+// Copy an effect definition with its strength scaled to gain.
+static void Haptics_scale_effect(union SDL_HapticEffect *scaled, union SDL_HapticEffect *definition, int gain){
+	*scaled = *definition;
+	switch(definition->type){
+		case SDL_HAPTIC_CONSTANT:
+			scaled->constant.level = HAPTICS_SCALE(definition->constant.level, gain);
+			scaled->constant.attack_level = HAPTICS_SCALE(definition->constant.attack_level, gain);
+			scaled->constant.fade_level = HAPTICS_SCALE(definition->constant.fade_level, gain);
+			break;
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			scaled->periodic.magnitude = HAPTICS_SCALE(definition->periodic.magnitude, gain);
+			scaled->periodic.offset = HAPTICS_SCALE(definition->periodic.offset, gain);
+			scaled->periodic.attack_level = HAPTICS_SCALE(definition->periodic.attack_level, gain);
+			scaled->periodic.fade_level = HAPTICS_SCALE(definition->periodic.fade_level, gain);
+			break;
+		case SDL_HAPTIC_SPRING:
+		case SDL_HAPTIC_DAMPER:
+		case SDL_HAPTIC_INERTIA:
+		case SDL_HAPTIC_FRICTION:
+			for(int i = 0; i < 3; i++){
+				scaled->condition.right_sat[i] = HAPTICS_SCALE(definition->condition.right_sat[i], gain);
+				scaled->condition.left_sat[i] = HAPTICS_SCALE(definition->condition.left_sat[i], gain);
+				scaled->condition.right_coeff[i] = HAPTICS_SCALE(definition->condition.right_coeff[i], gain);
+				scaled->condition.left_coeff[i] = HAPTICS_SCALE(definition->condition.left_coeff[i], gain);
+			}
+			break;
+		case SDL_HAPTIC_RAMP:
+			scaled->ramp.start = HAPTICS_SCALE(definition->ramp.start, gain);
+			scaled->ramp.end = HAPTICS_SCALE(definition->ramp.end, gain);
+			scaled->ramp.attack_level = HAPTICS_SCALE(definition->ramp.attack_level, gain);
+			scaled->ramp.fade_level = HAPTICS_SCALE(definition->ramp.fade_level, gain);
+			break;
+		case SDL_HAPTIC_LEFTRIGHT:
+			scaled->leftright.large_magnitude = HAPTICS_SCALE(definition->leftright.large_magnitude, gain);
+			scaled->leftright.small_magnitude = HAPTICS_SCALE(definition->leftright.small_magnitude, gain);
+			break;
+		case SDL_HAPTIC_CUSTOM:
+			// custom sample data is shared with the caller and left unscaled
+			scaled->custom.attack_level = HAPTICS_SCALE(definition->custom.attack_level, gain);
+			scaled->custom.fade_level = HAPTICS_SCALE(definition->custom.fade_level, gain);
+			break;
+	}
+}
+
+// Definition to upload to a player device.
+static union SDL_HapticEffect *Haptics_player_definition(int player, int effect){
+	if(haptics.players[player].scaled){
+		return &haptics.players[player].scaledDefinitions[effect];
+	}
+	return &haptics.effectDefinitions[effect];
+}
+
+// Rebuild the gain scaled definition of an effect for a player.
+static void Haptics_player_scale_effect(int player, int effect){
+	if(haptics.players[player].scaled){
+		Haptics_scale_effect(&haptics.players[player].scaledDefinitions[effect], &haptics.effectDefinitions[effect], haptics.players[player].gain);
+	}
+}
+
+// Rebuild all gain scaled definitions for a player, or apply gain on the device when it supports it.
+static void Haptics_player_rescale(int player){
+	if(haptics.players[player].hardware_gain){
+		Haptics_device_call(HAPTICS_COMMAND_GAIN, player, 0, haptics.players[player].gain * 100 / HAPTICS_MAX_GAIN);
+		return;
+	}
+
+	haptics.players[player].scaled = (haptics.players[player].gain < HAPTICS_MAX_GAIN);
+	for(int i = 0; i < haptics.max_effects; i++){
+		Haptics_player_scale_effect(player, i);
+	}
+}
+
+// - Voice scheduling
+// Play time of an effect in milliseconds, SDL_HAPTIC_INFINITY when it does not end on its own.
+static Uint32 Haptics_effect_length(union SDL_HapticEffect *definition, Uint32 iterations){
+	Uint32 length = SDL_HAPTIC_INFINITY;
+	Uint32 delay = 0;
+	switch(definition->type){
+		case SDL_HAPTIC_CONSTANT:
+			length = definition->constant.length;
+			delay = definition->constant.delay;
+			break;
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			length = definition->periodic.length;
+			delay = definition->periodic.delay;
+			break;
+		case SDL_HAPTIC_SPRING:
+		case SDL_HAPTIC_DAMPER:
+		case SDL_HAPTIC_INERTIA:
+		case SDL_HAPTIC_FRICTION:
+			length = definition->condition.length;
+			delay = definition->condition.delay;
+			break;
+		case SDL_HAPTIC_RAMP:
+			length = definition->ramp.length;
+			delay = definition->ramp.delay;
+			break;
+		case SDL_HAPTIC_LEFTRIGHT:
+			length = definition->leftright.length;
+			break;
+		case SDL_HAPTIC_CUSTOM:
+			length = definition->custom.length;
+			delay = definition->custom.delay;
+			break;
+	}
+	if((length == SDL_HAPTIC_INFINITY) || (iterations == SDL_HAPTIC_INFINITY)){
+		return SDL_HAPTIC_INFINITY;
+	}
+	// end ticks are compared as signed differences, longer effects never end
+	Uint64 total = delay + ((Uint64)length * (iterations ? iterations : 1));
+	if(total > INT32_MAX){
+		return SDL_HAPTIC_INFINITY;
+	}
+	return (Uint32)total;
+}
+
+// Free the voice of an effect that is no longer playing.
+static void Haptics_player_release_voice(int player, int effect){
+	if(haptics.players[player].until[effect]){
+		haptics.players[player].until[effect] = 0;
+		haptics.players[player].playing--;
+	}
+}
+
+// - Retrigger policies
+// Forget when an effect of a player started or ends, and any restart waiting on it.
+static void Haptics_player_reset_retrigger(int player, int effect){
+	Uint32 *extending = &haptics.players[player].extending[effect / 32];
+	Uint32 bit = 1u << (effect % 32);
+	if(*extending & bit){
+		*extending &= ~bit;
+		haptics.extending--;
+	}
+	haptics.players[player].retrigger[effect] = 0;
+}
+
+// Forget the retrigger state of all effects of a player.
+static void Haptics_player_clear_retriggers(int player){
+	for(int i = 0; i < haptics.max_effects; i++){
+		if(haptics.players[player].retrigger[i]){
+			Haptics_player_reset_retrigger(player, i);
+		}
+	}
+}
+
+// Check an effect with a retrigger policy may start. Extended effects are marked to restart when they end.
+static int Haptics_player_retrigger(int player, int effect){
+	Uint32 at = haptics.players[player].retrigger[effect];
+	if(!at){
+		return 1;
+	}
+	Uint32 now = SDL_GetTicks();
+	if(haptics.effectRetrigger[effect] == HAPTICS_RETRIGGER_INTERVAL){
+		return (Sint32)(now - at) >= (Sint32)haptics.effectInterval[effect];
+	}
+	if((at != SDL_HAPTIC_INFINITY) && ((Sint32)(now - at) >= 0)){
+		return 1;
+	}
+	Uint32 *extending = &haptics.players[player].extending[effect / 32];
+	Uint32 bit = 1u << (effect % 32);
+	if((haptics.effectRetrigger[effect] == HAPTICS_RETRIGGER_EXTEND) && (at != SDL_HAPTIC_INFINITY) && !(*extending & bit)){
+		*extending |= bit;
+		haptics.extending++;
+	}
+	return 0;
+}
+
+// Note when an effect with a retrigger policy started, or when it ends, once it has started.
+static void Haptics_player_retriggered(int player, int effect, Uint32 iterations){
+	Uint32 *at = &haptics.players[player].retrigger[effect];
+	Uint32 now = SDL_GetTicks();
+	if(haptics.effectRetrigger[effect] == HAPTICS_RETRIGGER_INTERVAL){
+		*at = now;
+	}
+	else{
+		Uint32 length = Haptics_effect_length(&haptics.effectDefinitions[effect], iterations);
+		*at = (length == SDL_HAPTIC_INFINITY) ? SDL_HAPTIC_INFINITY : (now + length);
+	}
+	// zero marks an idle effect
+	if(!*at){
+		*at = 1;
+	}
+}
+
+// Free the voice of an effect stopped before it ended. It may start again right away, though not sooner than its interval.
+static void Haptics_player_cut_voice(int player, int effect){
+	Haptics_player_release_voice(player, effect);
+	if(haptics.effectRetrigger[effect] != HAPTICS_RETRIGGER_INTERVAL){
+		Haptics_player_reset_retrigger(player, effect);
+	}
+}
+
+// Free all voices of a player device.
+static void Haptics_player_clear_voices(int player){
+	Haptics_player_clear_retriggers(player);
+	for(int i = 0; (i < haptics.max_effects) && haptics.players[player].playing; i++){
+		Haptics_player_release_voice(player, i);
+	}
+}
+
+// Free the voices of effects that have finished playing.
+static void Haptics_player_expire_voices(int player, Uint32 now){
+	for(int i = 0; (i < haptics.max_effects) && haptics.players[player].playing; i++){
+		Uint32 until = haptics.players[player].until[i];
+		if(until && (until != SDL_HAPTIC_INFINITY) && ((Sint32)(now - until) >= 0)){
+			Haptics_player_release_voice(player, i);
+		}
+	}
+}
+
+// Claim a voice for an effect about to run, stopping the lowest priority, oldest voice when all are busy.
+static int Haptics_player_claim_voice(int player, int effect, Uint32 iterations){
+	HapticsPlayer *p = &haptics.players[player];
+	// without a voice count the device decides what plays
+	if(p->voices <= 0){
+		return 1;
+	}
+
+	Uint32 now = SDL_GetTicks();
+	Haptics_player_expire_voices(player, now);
+	if(!p->until[effect] && (p->playing >= p->voices)){
+		int victim = -1;
+		for(int i = 0; i < haptics.max_effects; i++){
+			if(!p->until[i]){
+				continue;
+			}
+			if((victim < 0) || (haptics.effectPriorities[i] < haptics.effectPriorities[victim]) || ((haptics.effectPriorities[i] == haptics.effectPriorities[victim]) && (p->used[i] < p->used[victim]))){
+				victim = i;
+			}
+		}
+		if((victim < 0) || (haptics.effectPriorities[victim] > haptics.effectPriorities[effect])){
+			haptics.voiceStats.rejections++;
+			return 0;
+		}
+		Haptics_device_call(HAPTICS_COMMAND_STOP, player, victim, 0);
+		Haptics_player_cut_voice(player, victim);
+		haptics.voiceStats.steals++;
+	}
+
+	if(!p->until[effect]){
+		p->playing++;
+	}
+	Uint32 length = Haptics_effect_length(&haptics.effectDefinitions[effect], iterations);
+	p->until[effect] = (length == SDL_HAPTIC_INFINITY) ? SDL_HAPTIC_INFINITY : (now + length);
+	// zero marks an idle voice
+	if(!p->until[effect]){
+		p->until[effect] = 1;
+	}
+	return 1;
+}
+
+// - Software mixing
+// Absolute level as a fraction of the full level.
+static float Haptics_level(Sint32 level){
+	return ((level < 0) ? -level : level) / 32767.0f;
+}
+
+// Start a mixer voice for an effect, restarting the effect's voice when it is already playing.
+// Returns 0 when higher priority effects hold every voice, -1 for effects that cannot be mixed.
+static int Haptics_player_mix_effect(int player, int effect, Uint32 iterations, int gain){
+	HapticsMixer *mixer = &haptics.players[player].mixer;
+	union SDL_HapticEffect *definition = &haptics.effectDefinitions[effect];
+
+	// envelope, waveform and motor shares, normalized to 0 to 1
+	float magnitude = 1.0f, large = 0.0f, small = 0.0f, ramp = 0.0f;
+	float attack_length = 0.0f, attack_level = 0.0f, fade_length = 0.0f, fade_level = 0.0f;
+	float period = 0.0f, wave_offset = 1.0f, wave_slope = 0.0f, wave_peak = 0.0f;
+	Uint32 length, delay = 0;
+	switch(definition->type){
+		case SDL_HAPTIC_CONSTANT:
+			magnitude = Haptics_level(definition->constant.level);
+			large = small = 1.0f;
+			length = definition->constant.length;
+			delay = definition->constant.delay;
+			attack_length = definition->constant.attack_length;
+			attack_level = definition->constant.attack_level / 32767.0f;
+			fade_length = definition->constant.fade_length;
+			fade_level = definition->constant.fade_level / 32767.0f;
+			break;
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			magnitude = Haptics_level(definition->periodic.magnitude);
+			large = small = 1.0f;
+			length = definition->periodic.length;
+			delay = definition->periodic.delay;
+			attack_length = definition->periodic.attack_length;
+			attack_level = definition->periodic.attack_level / 32767.0f;
+			fade_length = definition->periodic.fade_length;
+			fade_level = definition->periodic.fade_level / 32767.0f;
+			period = definition->periodic.period;
+			// motors cannot follow the waveform, so it modulates the rumble strength
+			if(!period){
+				break;
+			}
+			if(definition->type == SDL_HAPTIC_SAWTOOTHUP){
+				wave_offset = 0.0f;
+				wave_slope = 1.0f;
+			}
+			else if(definition->type == SDL_HAPTIC_SAWTOOTHDOWN){
+				wave_slope = -1.0f;
+			}
+			else{
+				wave_peak = -1.0f;
+			}
+			break;
+		case SDL_HAPTIC_RAMP:
+			magnitude = Haptics_level(definition->ramp.start);
+			large = small = 1.0f;
+			length = definition->ramp.length;
+			delay = definition->ramp.delay;
+			attack_length = definition->ramp.attack_length;
+			attack_level = definition->ramp.attack_level / 32767.0f;
+			fade_length = definition->ramp.fade_length;
+			fade_level = definition->ramp.fade_level / 32767.0f;
+			if(length && (length != SDL_HAPTIC_INFINITY)){
+				ramp = (Haptics_level(definition->ramp.end) - magnitude) / length;
+			}
+			break;
+		case SDL_HAPTIC_LEFTRIGHT:
+			large = definition->leftright.large_magnitude / 65535.0f;
+			small = definition->leftright.small_magnitude / 65535.0f;
+			length = definition->leftright.length;
+			break;
+		default:
+			// condition and custom effects cannot be mixed into motor rumble
+			return -1;
+	}
+
+	// restart the effect's voice, take a free voice or steal the lowest priority, oldest voice
+	int voice = -1;
+	for(int v = 0; v < mixer->count; v++){
+		if(mixer->effect[v] == effect){
+			voice = v;
+			break;
+		}
+	}
+	if((voice < 0) && (mixer->count < haptics.sizes.max_mixer_voices)){
+		voice = mixer->count++;
+	}
+	if(voice < 0){
+		for(int v = 0; v < mixer->count; v++){
+			int priority = haptics.effectPriorities[mixer->effect[v]];
+			if((voice < 0) || (priority < haptics.effectPriorities[mixer->effect[voice]]) || ((priority == haptics.effectPriorities[mixer->effect[voice]]) && ((Sint32)(mixer->start[v] - mixer->start[voice]) < 0))){
+				voice = v;
+			}
+		}
+		if(haptics.effectPriorities[mixer->effect[voice]] > haptics.effectPriorities[effect]){
+			haptics.voiceStats.rejections++;
+			return 0;
+		}
+		if(haptics.effectRetrigger[mixer->effect[voice]] != HAPTICS_RETRIGGER_INTERVAL){
+			Haptics_player_reset_retrigger(player, mixer->effect[voice]);
+		}
+		haptics.voiceStats.steals++;
+	}
+
+	float scale = (float)gain / HAPTICS_MAX_GAIN;
+	mixer->effect[voice] = effect;
+	mixer->start[voice] = SDL_GetTicks() + delay;
+	if((length == SDL_HAPTIC_INFINITY) || (iterations == SDL_HAPTIC_INFINITY)){
+		mixer->length[voice] = FLT_MAX;
+		fade_length = 0.0f;
+	}
+	else{
+		mixer->length[voice] = (float)length * (iterations ? iterations : 1);
+	}
+	// without an attack or fade the envelope stays at the full level
+	mixer->attack_rate[voice] = attack_length ? (1.0f / attack_length) : 0.0f;
+	mixer->attack_level[voice] = (attack_length && magnitude) ? (attack_level / magnitude) : 1.0f;
+	mixer->fade_rate[voice] = fade_length ? (1.0f / fade_length) : 0.0f;
+	mixer->fade_level[voice] = (fade_length && magnitude) ? (fade_level / magnitude) : 1.0f;
+	mixer->period_rate[voice] = period ? (1.0f / period) : 0.0f;
+	mixer->wave_offset[voice] = wave_offset;
+	mixer->wave_slope[voice] = wave_slope;
+	mixer->wave_peak[voice] = wave_peak;
+	mixer->base[voice] = magnitude * scale;
+	mixer->ramp[voice] = ramp * scale;
+	mixer->large[voice] = large;
+	mixer->small[voice] = small;
+	return 1;
+}
+
+// Stop the mixer voice of an effect.
+static void Haptics_player_unmix_effect(int player, int effect){
+	HapticsMixer *mixer = &haptics.players[player].mixer;
+	for(int v = 0; v < mixer->count; v++){
+		if(mixer->effect[v] == effect){
+			mixer->count--;
+			mixer->effect[v] = mixer->effect[mixer->count];
+			mixer->start[v] = mixer->start[mixer->count];
+			// the float lanes follow each other from the length lane
+			for(int lane = 0; lane < HAPTICS_MIXER_LANES; lane++){
+				mixer->length[(lane * haptics.sizes.max_mixer_voices) + v] = mixer->length[(lane * haptics.sizes.max_mixer_voices) + mixer->count];
+			}
+			return;
+		}
+	}
+}
+
+// Mix the playing voices of a player and push the motor magnitudes to the device when they change.
+static void Haptics_player_mix(int player, Uint32 now){
+	HapticsMixer *mixer = &haptics.players[player].mixer;
+
+	// drop finished voices
+	for(int v = 0; v < mixer->count; ){
+		float t = (float)(Sint32)(now - mixer->start[v]);
+		if(t >= mixer->length[v]){
+			Haptics_player_unmix_effect(player, mixer->effect[v]);
+		}
+		else{
+			v++;
+		}
+	}
+
+	float large = 0.0f, small = 0.0f;
+	float remaining = 0.0f;
+	for(int v = 0; v < mixer->count; v++){
+		float t = (float)(Sint32)(now - mixer->start[v]);
+		remaining = ((mixer->length[v] - t) > remaining) ? (mixer->length[v] - t) : remaining;
+		float active = (t >= 0.0f) ? 1.0f : 0.0f;
+		float attack = t * mixer->attack_rate[v];
+		attack = (attack < 1.0f) ? attack : 1.0f;
+		float fade = (mixer->length[v] - t) * mixer->fade_rate[v];
+		fade = (fade < 1.0f) ? fade : 1.0f;
+		float envelope = (mixer->attack_level[v] + ((1.0f - mixer->attack_level[v]) * attack)) * (mixer->fade_level[v] + ((1.0f - mixer->fade_level[v]) * fade));
+		float cycle = t * mixer->period_rate[v];
+		float phase = cycle - (float)(int)cycle;
+		float peak = (2.0f * phase) - 1.0f;
+		peak = (peak < 0.0f) ? -peak : peak;
+		float wave = mixer->wave_offset[v] + (mixer->wave_slope[v] * phase) + (mixer->wave_peak[v] * peak);
+		float level = active * envelope * wave * (mixer->base[v] + (mixer->ramp[v] * t));
+		large += level * mixer->large[v];
+		small += level * mixer->small[v];
+	}
+
+	// devices without hardware gain get the player gain mixed in
+	if(!haptics.players[player].hardware_gain){
+		large *= (float)haptics.players[player].gain / HAPTICS_MAX_GAIN;
+		small *= (float)haptics.players[player].gain / HAPTICS_MAX_GAIN;
+	}
+	Uint16 large_magnitude = (large < 1.0f) ? (Uint16)(large * 65535.0f) : 65535;
+	Uint16 small_magnitude = (small < 1.0f) ? (Uint16)(small * 65535.0f) : 65535;
+
+	int changed = (large_magnitude != mixer->large_magnitude) || (small_magnitude != mixer->small_magnitude);
+	int silent = !large_magnitude && !small_magnitude;
+	// a steady mix is re-run before the mixer effect ends
+	if(!changed && (silent || ((now - mixer->pushed) < (HAPTICS_MIXER_LENGTH / 2)))){
+		return;
+	}
+	mixer->large_magnitude = large_magnitude;
+	mixer->small_magnitude = small_magnitude;
+	mixer->pushed = now;
+
+	// the mix plays until its longest voice ends, without waiting on an update to stop it
+	union SDL_HapticEffect definition = { .type = SDL_HAPTIC_LEFTRIGHT };
+	definition.leftright.length = silent ? 0 : ((remaining < HAPTICS_MIXER_LENGTH) ? (Uint32)(remaining + 0.5f) : HAPTICS_MIXER_LENGTH);
+	definition.leftright.large_magnitude = large_magnitude;
+	definition.leftright.small_magnitude = small_magnitude;
+	if(haptics.players[player].rumble){
+		Haptics_device_upload(HAPTICS_COMMAND_RUMBLE, player, HAPTICS_MIXER_EFFECT, &definition);
+		return;
+	}
+
+	if(silent){
+		Haptics_device_call(HAPTICS_COMMAND_STOP, player, HAPTICS_MIXER_EFFECT, 0);
+		return;
+	}
+	if(changed){
+		Haptics_device_upload(HAPTICS_COMMAND_UPDATE, player, HAPTICS_MIXER_EFFECT, &definition);
+	}
+	Haptics_device_call(HAPTICS_COMMAND_RUN, player, HAPTICS_MIXER_EFFECT, 1);
+}
+
+// Silence all mixer voices of a player.
+static void Haptics_player_clear_mix(int player){
+	haptics.players[player].mixer.count = 0;
+	haptics.players[player].mixer.large_magnitude = 0;
+	haptics.players[player].mixer.small_magnitude = 0;
+}
+
+// Resume a paused player, pushing the mix again to rumble joysticks that were silenced.
+static void Haptics_player_resume(int player){
+	haptics.players[player].paused = 0;
+	if(haptics.players[player].rumble){
+		haptics.players[player].mixer.large_magnitude = 0;
+		haptics.players[player].mixer.small_magnitude = 0;
+	}
+}
+
+// - Device effect slot management
+// Remove an uploaded effect from a player device.
+static void Haptics_player_release_effect(int player, int effect){
+	if(haptics.players[player].effect[effect] < 0){
+		return;
+	}
+	Haptics_device_call(HAPTICS_COMMAND_DESTROY, player, effect, 0);
+	haptics.players[player].effect[effect] = -1;
+	haptics.players[player].altered[effect] = 0;
+	if(haptics.players[player].resident > 0){
+		haptics.players[player].resident--;
+	}
+	Haptics_player_cut_voice(player, effect);
+}
+
+// Release the least recently used effect on a player device.
+static int Haptics_player_evict_effect(int player){
+	HapticsPlayer *p = &haptics.players[player];
+	if(p->playing){
+		Haptics_player_expire_voices(player, SDL_GetTicks());
+	}
+	// idle effects go first, playing effects only when every resident effect is playing
+	int victim = -1;
+	for(int i = 0; i < haptics.max_effects; i++){
+		if(p->effect[i] < 0){
+			continue;
+		}
+		if((victim < 0) || (!p->until[i] && p->until[victim]) || ((!p->until[i] == !p->until[victim]) && (p->used[i] < p->used[victim]))){
+			victim = i;
+		}
+	}
+
+	if(victim < 0){
+		return 0;
+	}
+	Haptics_player_release_effect(player, victim);
+	return 1;
+}
+
+// Upload an effect to a player device, evicting idle effects when the device is full.
+static int Haptics_player_upload_effect(int player, int effect, union SDL_HapticEffect *definition){
+	if(haptics.players[player].resident >= haptics.players[player].slots){
+		Haptics_player_evict_effect(player);
+	}
+
+	haptics.players[player].effect[effect] = Haptics_device_upload(HAPTICS_COMMAND_NEW, player, effect, definition);
+	// the device may hold fewer effects than it reports, retry once with a free slot
+	if((haptics.players[player].effect[effect] < 0) && Haptics_player_evict_effect(player)){
+		haptics.players[player].effect[effect] = Haptics_device_upload(HAPTICS_COMMAND_NEW, player, effect, definition);
+	}
+	if(haptics.players[player].effect[effect] < 0){
+		HAPTICS_COUNT(player, effect, upload_failures);
+		return 0;
+	}
+
+	haptics.players[player].resident++;
+	haptics.players[player].used[effect] = ++haptics.players[player].clock;
+	haptics.players[player].altered[effect] = 0;
+	return 1;
+}
+
+// Change an effect on a player device, in place when possible so the device effect id stays stable.
+static int Haptics_player_replace_effect(int player, int effect, union SDL_HapticEffect *definition, int retype){
+	// mixed effects are read from the registered definitions when run
+	if(haptics.players[player].mixing){
+		return 1;
+	}
+	if((haptics.players[player].effect[effect] >= 0) && !retype){
+		if(Haptics_device_upload(HAPTICS_COMMAND_UPDATE, player, effect, definition) >= 0){
+			haptics.players[player].altered[effect] = 0;
+			return 1;
+		}
+	}
+
+	// effect type changed or the device refused the update
+	Haptics_player_release_effect(player, effect);
+	// lazy devices pick the definition up on the next run
+	if(haptics.lazy){
+		return 1;
+	}
+	return Haptics_player_upload_effect(player, effect, definition);
+}
+
+// Apply a changed gain to an open player device.
+static void Haptics_player_apply_gain(int player){
+	Haptics_player_rescale(player);
+	if(haptics.players[player].hardware_gain){
+		return;
+	}
+
+	// push the rescaled definitions to the uploaded effects
+	for(int i = 0; i < haptics.max_effects; i++){
+		if(haptics.players[player].effect[i] >= 0){
+			Haptics_player_replace_effect(player, i, Haptics_player_definition(player, i), 0);
+		}
+	}
+}
+
+// - Haptic Device Detection - call on device add / remove
+// Open a joystick without haptic support for rumble, with effects mixed in software.
+static int Haptics_open_rumble_for_player(SDL_Joystick *joystick, int player){
+	// rumble support can only be probed by rumbling
+	if(!joystick || (haptics.backend.rumble(haptics.backend.data, joystick, 0, 0, 0) != 0)){
+		return 0;
+	}
+
+	haptics.players[player].rumble = joystick;
+	haptics.players[player].mixing = 1;
+	haptics.players[player].hardware_gain = 0;
+	haptics.players[player].scaled = 0;
+	haptics.players[player].slots = 0;
+	haptics.players[player].voices = 0;
+	haptics.players[player].resident = 0;
+	haptics.players[player].playing = 0;
+	for(int i = 0; i < haptics.device_effects; i++){
+		haptics.players[player].effect[i] = -1;
+	}
+	Haptics_player_clear_mix(player);
+	return 1;
+}
+
+// - Application of effects to devices - on device add
+// Set up a player for a device opened on its joystick, uploading effects unless they are uploaded lazily or in the background.
+static int Haptics_player_attach(SDL_Joystick *joystick, int player, void *device, HapticsDeviceInfo info){
+	haptics.players[player].rumble = NULL;
+	haptics.players[player].paused = 0;
+	haptics.players[player].uploading = 0;
+	haptics.players[player].device = device;
+	if(!haptics.players[player].device){
+		return Haptics_open_rumble_for_player(joystick, player);
+	}
+
+	haptics.players[player].slots = info.effects;
+	if((haptics.players[player].slots <= 0) || (haptics.players[player].slots > haptics.max_effects)){
+		haptics.players[player].slots = haptics.max_effects;
+	}
+	haptics.players[player].voices = info.playing;
+	if(haptics.players[player].voices < 0){
+		haptics.players[player].voices = 0;
+	}
+	haptics.players[player].resident = 0;
+	haptics.players[player].clock = 0;
+	haptics.players[player].playing = 0;
+	for(int i = 0; i < haptics.max_effects; i++){
+		haptics.players[player].effect[i] = -1;
+		haptics.players[player].used[i] = 0;
+		haptics.players[player].until[i] = 0;
+		haptics.players[player].altered[i] = 0;
+	}
+	Haptics_player_clear_retriggers(player);
+	haptics.players[player].effect[HAPTICS_MIXER_EFFECT] = -1;
+	unsigned int features = info.features;
+	haptics.players[player].hardware_gain = (features & SDL_HAPTIC_GAIN) ? 1 : 0;
+	haptics.players[player].scaled = 0;
+	Haptics_player_rescale(player);
+
+	// mixed effects all play through one left/right effect
+	haptics.players[player].mixing = 0;
+	Haptics_player_clear_mix(player);
+	if(haptics.mixing && (features & SDL_HAPTIC_LEFTRIGHT)){
+		union SDL_HapticEffect definition = { .type = SDL_HAPTIC_LEFTRIGHT };
+		definition.leftright.length = HAPTICS_MIXER_LENGTH;
+		if(Haptics_device_upload(HAPTICS_COMMAND_NEW, player, HAPTICS_MIXER_EFFECT, &definition) >= 0){
+			haptics.players[player].mixing = 1;
+			return 1;
+		}
+	}
+
+	// effects are uploaded as they are first run
+	if(haptics.lazy){
+		return 1;
+	}
+
+	// effects are uploaded by the next updates, most recently used first
+	if(haptics.hotplug){
+		haptics.players[player].uploading = 1;
+		return 1;
+	}
+
+	// try to appply registered effects
+	for(int i = 0; i < haptics.max_effects; i++){
+		haptics.players[player].effect[i] = Haptics_device_upload(HAPTICS_COMMAND_NEW, player, i, Haptics_player_definition(player, i));
+		if(haptics.players[player].effect[i] >= 0){
+			haptics.players[player].resident++;
+		}
+		else if(haptics.effectDefinitions[i].type){
+			HAPTICS_COUNT(player, i, upload_failures);
+		}
+	}
+
+	return 1;
+}
+
+static int Haptics_open_player(SDL_Joystick *joystick, int player){
+	if(!Haptics_player_valid(player)){
+		return 0;
+	}
+	// keep the worker idle while the device is opened
+	Haptics_sync();
+
+	HapticsDeviceInfo info = { 0, 0, 0 };
+	Uint64 start = SDL_GetPerformanceCounter();
+	void *device = haptics.backend.open(haptics.backend.data, joystick, &info);
+	Uint64 end = SDL_GetPerformanceCounter();
+#ifndef HAPTICS_NO_STATS
+	Haptics_count_latency(HAPTICS_CALL_OPEN, end - start);
+#endif
+	if(haptics.trace){
+		Haptics_trace_event(HAPTICS_TRACE_CALLS + HAPTICS_CALL_OPEN, player, -1, start, end);
+	}
+	int result = Haptics_player_attach(joystick, player, device, info);
+	Haptics_player_refresh(player);
+	return result;
+}
+
+// Hand the open of a joystick to the worker thread, the player is set up by a later update.
+static void Haptics_open_player_background(SDL_Joystick *joystick, int player){
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	HapticsOpening *opening = &haptics.players[player].opening;
+	if(atomic_load_explicit(&opening->state, memory_order_acquire) != HAPTICS_OPENING_IDLE){
+		return;
+	}
+	opening->joystick = joystick;
+	atomic_store_explicit(&opening->state, HAPTICS_OPENING_PENDING, memory_order_relaxed);
+	HapticsCommand command;
+	command.type = HAPTICS_COMMAND_OPEN;
+	command.player = player;
+	command.effect = -1;
+	command.device = NULL;
+	command.joystick = joystick;
+	command.value = 0;
+	Haptics_queue_push(haptics.queue, &command);
+}
+
+// Set up a player whose device the worker has opened, returning 0 while the open is still in progress.
+static int Haptics_player_collect_open(int player){
+	HapticsOpening *opening = &haptics.players[player].opening;
+	if(atomic_load_explicit(&opening->state, memory_order_acquire) != HAPTICS_OPENING_DONE){
+		return 0;
+	}
+	int result = Haptics_player_attach(opening->joystick, player, opening->device, opening->info);
+	Haptics_player_refresh(player);
+	atomic_store_explicit(&opening->state, HAPTICS_OPENING_IDLE, memory_order_relaxed);
+	Haptics_capture(HAPTICS_CAPTURE_OPEN, player, -1, result);
+	if(result){
+		Haptics_player_set_enabled(player, 1);
+	}
+	return 1;
+}
+
+// Upload the next few effects to a player device, most recently used first.
+static void Haptics_player_upload_next(int player, int count){
+	HapticsPlayer *p = &haptics.players[player];
+	// a full device keeps the most recently used effects, the rest upload lazily on run
+	for(; (count > 0) && (p->resident < p->slots); count--){
+		// effects run while uploading move to the front
+		int next = -1;
+		for(int i = 0; i < haptics.max_effects; i++){
+			if(haptics.effectDefinitions[i].type && (p->effect[i] < 0) && ((next < 0) || (haptics.effectUsed[i] > haptics.effectUsed[next]))){
+				next = i;
+			}
+		}
+		// a device refusing an upload will refuse the rest too
+		if((next < 0) || !Haptics_player_upload_effect(player, next, Haptics_player_definition(player, next))){
+			p->uploading = 0;
+			return;
+		}
+	}
+	if(p->resident >= p->slots){
+		p->uploading = 0;
+	}
+}
+
+int Haptics_open_joystick_for_player(SDL_Joystick *joystick, int player){
+	Uint64 start = Haptics_trace_begin();
+	int result = Haptics_open_player(joystick, player);
+	Haptics_trace_end(HAPTICS_TRACE_OPEN, player, -1, start);
+	Haptics_capture(HAPTICS_CAPTURE_OPEN, player, -1, result);
+	return result;
+}
+
+static int Haptics_close_player(int player){
+	if(!Haptics_player_valid(player)){
+		return 0;
+	}
+	// a background open completes first, so its device is closed too
+	if(atomic_load_explicit(&haptics.players[player].opening.state, memory_order_acquire) == HAPTICS_OPENING_PENDING){
+		Haptics_sync();
+	}
+	if(atomic_load_explicit(&haptics.players[player].opening.state, memory_order_acquire) == HAPTICS_OPENING_DONE){
+		Haptics_capture_nest(1);
+		Haptics_player_collect_open(player);
+		Haptics_capture_nest(-1);
+	}
+	haptics.players[player].uploading = 0;
+	Haptics_device_call(HAPTICS_COMMAND_CLOSE, player, 0, 0);
+	haptics.players[player].device = 0;
+	haptics.players[player].rumble = NULL;
+	haptics.players[player].paused = 0;
+	Haptics_player_refresh(player);
+
+	// clear registered effects
+	for(int i = 0; i < haptics.device_effects; i++){
+		haptics.players[player].effect[i] = -1;
+	}
+	haptics.players[player].mixing = 0;
+	Haptics_player_clear_mix(player);
+	haptics.players[player].resident = 0;
+	Haptics_player_clear_voices(player);
+	Haptics_player_clear_timelines(player);
+
+	return 1;
+}
+
+int Haptics_close_for_player(int player){
+	Haptics_capture(HAPTICS_CAPTURE_CLOSE, player, -1, 0);
+	Uint64 start = Haptics_trace_begin();
+	int result = Haptics_close_player(player);
+	Haptics_trace_end(HAPTICS_TRACE_CLOSE, player, -1, start);
+	return result;
+}
+
+
+// Effect definition / management
+
+// - Register and get reference for effect
+static int Haptics_register(union SDL_HapticEffect *sdlHapticEffect){
+	int effect = Haptics_effect_alloc();
+	if(effect < 0){
+		return -1;
+	}
+	haptics.effectDefinitions[effect] = *sdlHapticEffect;
+	Haptics_publish();
+
+	for(int i = 0; i < haptics.max_players; i++){
+		if(haptics.players[i].device){
+			Haptics_player_scale_effect(i, effect);
+			Haptics_player_replace_effect(i, effect, Haptics_player_definition(i, effect), 1);
+		}
+	}
+	return haptics.effectHandles[effect];
+}
+
+int Haptics_register_effect(union SDL_HapticEffect *sdlHapticEffect){
+	Uint64 start = Haptics_trace_begin();
+	int effect = Haptics_register(sdlHapticEffect);
+	Haptics_trace_end(HAPTICS_TRACE_REGISTER, -1, effect, start);
+	Haptics_capture_definition(HAPTICS_CAPTURE_REGISTER_EFFECT, -1, effect, sdlHapticEffect);
+	return effect;
+}
+
+void Haptics_register_effect_at(union SDL_HapticEffect *sdlHapticEffect, int handle){
+	Haptics_capture_definition(HAPTICS_CAPTURE_REGISTER_EFFECT_AT, -1, handle, sdlHapticEffect);
+	int id = handle & HAPTICS_HANDLE_INDEX_MASK;
+	if((handle < 0) || (id >= haptics.max_effects)){
+		return;
+	}
+	// the slot takes the generation of the given handle
+	haptics.effectHandles[id] = handle;
+	haptics.registered[id / 32] |= (1u << (id % 32));
+	haptics.removed[id / 32] &= ~(1u << (id % 32));
+
+	int retype = (haptics.effectDefinitions[id].type != sdlHapticEffect->type);
+	haptics.effectDefinitions[id] = *sdlHapticEffect;
+	Haptics_publish();
+
+	for(int i = 0; i < haptics.max_players; i++){
+		if(haptics.players[i].device){
+			Haptics_player_scale_effect(i, id);
+			Haptics_player_replace_effect(i, id, Haptics_player_definition(i, id), retype);
+		}
+	}
+}
+
+// - Delete an effect
+void Haptics_remove_effect(int effect){
+	Haptics_capture(HAPTICS_CAPTURE_REMOVE_EFFECT, -1, effect, 0);
+	effect = Haptics_effect_index(effect);
+	if(effect < 0){
+		return;
+	}
+	if(haptics.effectDefinitions[effect].type){
+		haptics.effectDefinitions[effect].type = 0;
+	}
+	haptics.effectPriorities[effect] = 0;
+	haptics.effectRetrigger[effect] = HAPTICS_RETRIGGER_RESTART;
+	haptics.effectInterval[effect] = 0;
+	for(int i = 0; i < haptics.max_players; i++){
+		Haptics_player_reset_retrigger(i, effect);
+	}
+	Haptics_effect_free(effect);
+	// triggers from other threads stop seeing the handle before its slot is reused
+	Haptics_publish();
+
+	// unregister effect from devices, and take it out of the mix of mixing players
+	for(int i = 0; i < haptics.max_players; i++){
+		if(haptics.players[i].mixing){
+			Haptics_player_unmix_effect(i, effect);
+			if(haptics.players[i].rumble){
+				Haptics_player_mix(i, SDL_GetTicks());
+			}
+		}
+		if(haptics.players[i].device){
+			Haptics_player_release_effect(i, effect);
+		}
+	}
+}
+
+// - Modify an effect
+static void Haptics_set(union SDL_HapticEffect *sdlHapticEffect, int effect){
+	effect = Haptics_effect_index(effect);
+	if(effect < 0){
+		return;
+	}
+	int retype = (haptics.effectDefinitions[effect].type != sdlHapticEffect->type);
+	haptics.effectDefinitions[effect] = *sdlHapticEffect;
+	Haptics_publish();
+
+	for(int i = 0; i < haptics.max_players; i++){
+		if(haptics.players[i].device){
+			Haptics_player_scale_effect(i, effect);
+			// failed uploads are counted in the stats
+			Haptics_player_replace_effect(i, effect, Haptics_player_definition(i, effect), retype);
+		}
+	}
+}
+
+void Haptics_set_effect(union SDL_HapticEffect *sdlHapticEffect, int effect){
+	Haptics_capture_definition(HAPTICS_CAPTURE_SET_EFFECT, -1, effect, sdlHapticEffect);
+	Uint64 start = Haptics_trace_begin();
+	Haptics_set(sdlHapticEffect, effect);
+	Haptics_trace_end(HAPTICS_TRACE_SET, -1, effect, start);
+}
+
+// - Set effect voice priority
+void Haptics_set_effect_priority(int effect, int priority){
+	Haptics_capture(HAPTICS_CAPTURE_SET_EFFECT_PRIORITY, -1, effect, priority);
+	effect = Haptics_effect_index(effect);
+	if(effect < 0){
+		return;
+	}
+	haptics.effectPriorities[effect] = priority;
+}
+
+void Haptics_set_effect_retrigger(int effect, HapticsRetrigger policy, Uint32 interval_ms){
+	Haptics_capture(HAPTICS_CAPTURE_SET_EFFECT_RETRIGGER, -1, effect, (interval_ms << 2) | (policy & 3));
+	effect = Haptics_effect_index(effect);
+	if((effect < 0) || (policy < HAPTICS_RETRIGGER_RESTART) || (policy > HAPTICS_RETRIGGER_INTERVAL)){
+		return;
+	}
+	// playing effects are tracked from their next start
+	for(int i = 0; i < haptics.max_players; i++){
+		Haptics_player_reset_retrigger(i, effect);
+	}
+	haptics.effectRetrigger[effect] = policy;
+	haptics.effectInterval[effect] = interval_ms;
+}
+
+// - Effect banks
+// Size of the entry of a banked effect type.
+#define HAPTICS_BANK_ENTRY_SIZE(body) (offsetof(HapticsBankEntry, body) + sizeof(((HapticsBankEntry *)0)->body))
+
+// Fields named alike in effect definitions and bank entries, copied either way.
+#define HAPTICS_BANK_COPY_DIRECTION(to, from) ((to).type = (from).type, (to).dir[0] = (from).dir[0], (to).dir[1] = (from).dir[1], (to).dir[2] = (from).dir[2])
+#define HAPTICS_BANK_COPY_TIMING(to, from) ((to).delay = (from).delay, (to).button = (from).button, (to).interval = (from).interval)
+#define HAPTICS_BANK_COPY_ENVELOPE(to, from) ((to).attack_length = (from).attack_length, (to).attack_level = (from).attack_level, (to).fade_length = (from).fade_length, (to).fade_level = (from).fade_level)
+#define HAPTICS_BANK_COPY_AXES(to, from, field) ((to).field[0] = (from).field[0], (to).field[1] = (from).field[1], (to).field[2] = (from).field[2])
+
+// Entry size for an effect type, 0 for types that cannot be banked.
+static int Haptics_bank_entry_size(Uint16 type){
+	switch(type){
+		case SDL_HAPTIC_LEFTRIGHT:
+			return HAPTICS_BANK_ENTRY_SIZE(leftright);
+		case SDL_HAPTIC_CONSTANT:
+			return HAPTICS_BANK_ENTRY_SIZE(constant);
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			return HAPTICS_BANK_ENTRY_SIZE(periodic);
+		case SDL_HAPTIC_RAMP:
+			return HAPTICS_BANK_ENTRY_SIZE(ramp);
+		case SDL_HAPTIC_SPRING:
+		case SDL_HAPTIC_DAMPER:
+		case SDL_HAPTIC_INERTIA:
+		case SDL_HAPTIC_FRICTION:
+			return HAPTICS_BANK_ENTRY_SIZE(condition);
+	}
+	return 0;
+}
+
+int Haptics_bank_encode(const union SDL_HapticEffect *sdlHapticEffect, int id, int priority, HapticsBankEntry *entry){
+	int size = Haptics_bank_entry_size(sdlHapticEffect->type);
+	if(!size){
+		return 0;
+	}
+	memset(entry, 0, size);
+	entry->type = sdlHapticEffect->type;
+	entry->size = size;
+	entry->index = id;
+	entry->priority = priority;
+	switch(sdlHapticEffect->type){
+		case SDL_HAPTIC_LEFTRIGHT:
+			entry->length = sdlHapticEffect->leftright.length;
+			entry->leftright.large_magnitude = sdlHapticEffect->leftright.large_magnitude;
+			entry->leftright.small_magnitude = sdlHapticEffect->leftright.small_magnitude;
+			break;
+		case SDL_HAPTIC_CONSTANT:
+			entry->length = sdlHapticEffect->constant.length;
+			HAPTICS_BANK_COPY_DIRECTION(entry->constant.direction, sdlHapticEffect->constant.direction);
+			HAPTICS_BANK_COPY_TIMING(entry->constant, sdlHapticEffect->constant);
+			entry->constant.level = sdlHapticEffect->constant.level;
+			HAPTICS_BANK_COPY_ENVELOPE(entry->constant.envelope, sdlHapticEffect->constant);
+			break;
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			entry->length = sdlHapticEffect->periodic.length;
+			HAPTICS_BANK_COPY_DIRECTION(entry->periodic.direction, sdlHapticEffect->periodic.direction);
+			HAPTICS_BANK_COPY_TIMING(entry->periodic, sdlHapticEffect->periodic);
+			entry->periodic.period = sdlHapticEffect->periodic.period;
+			entry->periodic.magnitude = sdlHapticEffect->periodic.magnitude;
+			entry->periodic.offset = sdlHapticEffect->periodic.offset;
+			entry->periodic.phase = sdlHapticEffect->periodic.phase;
+			HAPTICS_BANK_COPY_ENVELOPE(entry->periodic.envelope, sdlHapticEffect->periodic);
+			break;
+		case SDL_HAPTIC_RAMP:
+			entry->length = sdlHapticEffect->ramp.length;
+			HAPTICS_BANK_COPY_DIRECTION(entry->ramp.direction, sdlHapticEffect->ramp.direction);
+			HAPTICS_BANK_COPY_TIMING(entry->ramp, sdlHapticEffect->ramp);
+			entry->ramp.start = sdlHapticEffect->ramp.start;
+			entry->ramp.end = sdlHapticEffect->ramp.end;
+			HAPTICS_BANK_COPY_ENVELOPE(entry->ramp.envelope, sdlHapticEffect->ramp);
+			break;
+		default:
+			// condition effects take their direction per axis
+			entry->length = sdlHapticEffect->condition.length;
+			HAPTICS_BANK_COPY_TIMING(entry->condition, sdlHapticEffect->condition);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, right_sat);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, left_sat);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, right_coeff);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, left_coeff);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, deadband);
+			HAPTICS_BANK_COPY_AXES(entry->condition, sdlHapticEffect->condition, center);
+	}
+	return size;
+}
+
+// Effect definition of a checked bank entry.
+static void Haptics_bank_decode(const HapticsBankEntry *entry, union SDL_HapticEffect *sdlHapticEffect){
+	memset(sdlHapticEffect, 0, sizeof(union SDL_HapticEffect));
+	sdlHapticEffect->type = entry->type;
+	switch(entry->type){
+		case SDL_HAPTIC_LEFTRIGHT:
+			sdlHapticEffect->leftright.length = entry->length;
+			sdlHapticEffect->leftright.large_magnitude = entry->leftright.large_magnitude;
+			sdlHapticEffect->leftright.small_magnitude = entry->leftright.small_magnitude;
+			break;
+		case SDL_HAPTIC_CONSTANT:
+			sdlHapticEffect->constant.length = entry->length;
+			HAPTICS_BANK_COPY_DIRECTION(sdlHapticEffect->constant.direction, entry->constant.direction);
+			HAPTICS_BANK_COPY_TIMING(sdlHapticEffect->constant, entry->constant);
+			sdlHapticEffect->constant.level = entry->constant.level;
+			HAPTICS_BANK_COPY_ENVELOPE(sdlHapticEffect->constant, entry->constant.envelope);
+			break;
+		case SDL_HAPTIC_SINE:
+		case SDL_HAPTIC_TRIANGLE:
+		case SDL_HAPTIC_SAWTOOTHUP:
+		case SDL_HAPTIC_SAWTOOTHDOWN:
+			sdlHapticEffect->periodic.length = entry->length;
+			HAPTICS_BANK_COPY_DIRECTION(sdlHapticEffect->periodic.direction, entry->periodic.direction);
+			HAPTICS_BANK_COPY_TIMING(sdlHapticEffect->periodic, entry->periodic);
+			sdlHapticEffect->periodic.period = entry->periodic.period;
+			sdlHapticEffect->periodic.magnitude = entry->periodic.magnitude;
+			sdlHapticEffect->periodic.offset = entry->periodic.offset;
+			sdlHapticEffect->periodic.phase = entry->periodic.phase;
+			HAPTICS_BANK_COPY_ENVELOPE(sdlHapticEffect->periodic, entry->periodic.envelope);
+			break;
+		case SDL_HAPTIC_RAMP:
+			sdlHapticEffect->ramp.length = entry->length;
+			HAPTICS_BANK_COPY_DIRECTION(sdlHapticEffect->ramp.direction, entry->ramp.direction);
+			HAPTICS_BANK_COPY_TIMING(sdlHapticEffect->ramp, entry->ramp);
+			sdlHapticEffect->ramp.start = entry->ramp.start;
+			sdlHapticEffect->ramp.end = entry->ramp.end;
+			HAPTICS_BANK_COPY_ENVELOPE(sdlHapticEffect->ramp, entry->ramp.envelope);
+			break;
+		default:
+			sdlHapticEffect->condition.length = entry->length;
+			HAPTICS_BANK_COPY_TIMING(sdlHapticEffect->condition, entry->condition);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, right_sat);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, left_sat);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, right_coeff);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, left_coeff);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, deadband);
+			HAPTICS_BANK_COPY_AXES(sdlHapticEffect->condition, entry->condition, center);
+	}
+}
+
+// A registered effect matches a bank entry when it encodes to the same fields, whatever its padding holds.
+static int Haptics_bank_entry_matches(const HapticsBankEntry *entry, int id){
+	HapticsBankEntry registered;
+	int size = Haptics_bank_encode(&haptics.effectDefinitions[id], entry->index, entry->priority, &registered);
+	return (size > 0) && (registered.type == entry->type) && !memcmp(&registered.length, &entry->length, size - offsetof(HapticsBankEntry, length));
+}
+
+int Haptics_register_bank(const void *bank, size_t size){
+	const HapticsBankHeader *header = bank;
+	if(!haptics.tables || (size < sizeof(HapticsBankHeader)) || ((uintptr_t)bank & 3)){
+		return -1;
+	}
+	if((header->magic != HAPTICS_BANK_MAGIC) || (header->version != HAPTICS_BANK_VERSION) || (header->size > (size - sizeof(HapticsBankHeader)))){
+		return -1;
+	}
+
+	// check every entry first, so a bad bank registers nothing
+	const char *entries = (const char *)(header + 1);
+	Uint32 offset = 0;
+	for(Uint32 n = 0; n < header->count; n++){
+		const HapticsBankEntry *entry = (const HapticsBankEntry *)(entries + offset);
+		if((header->size - offset) < offsetof(HapticsBankEntry, leftright)){
+			return -1;
+		}
+		// entries may grow fields at their end in later versions
+		int entry_size = Haptics_bank_entry_size(entry->type);
+		if(!entry_size || (entry->size < entry_size) || (entry->size & 3) || (entry->size > (header->size - offset))){
+			return -1;
+		}
+		if((entry->index < 0) || ((entry->index & HAPTICS_HANDLE_INDEX_MASK) >= haptics.max_effects)){
+			return -1;
+		}
+		offset += entry->size;
+	}
+
+	// only changed effects are registered again, and uploaded to open devices
+	// the effect table is published once for the whole bank
+	Haptics_publish_hold(1);
+	offset = 0;
+	for(Uint32 n = 0; n < header->count; n++){
+		const HapticsBankEntry *entry = (const HapticsBankEntry *)(entries + offset);
+		int id = entry->index & HAPTICS_HANDLE_INDEX_MASK;
+		if((haptics.effectHandles[id] != entry->index) || !(haptics.registered[id / 32] & (1u << (id % 32))) || !Haptics_bank_entry_matches(entry, id)){
+			union SDL_HapticEffect definition;
+			Haptics_bank_decode(entry, &definition);
+			Haptics_register_effect_at(&definition, entry->index);
+		}
+		if(haptics.effectPriorities[id] != entry->priority){
+			Haptics_set_effect_priority(entry->index, entry->priority);
+		}
+		offset += entry->size;
+	}
+	Haptics_publish_hold(-1);
+	return header->count;
+}
+
+int Haptics_load_bank(const char *path){
+#ifdef _WIN32
+	// no mmap, read the bank in one go instead
+	size_t size = 0;
+	void *bank = SDL_LoadFile(path, &size);
+	if(!bank){
+		return -1;
+	}
+	int count = Haptics_register_bank(bank, size);
+	SDL_free(bank);
+	return count;
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		return -1;
+	}
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(HapticsBankHeader))){
+		close(fd);
+		return -1;
+	}
+	void *bank = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(bank == MAP_FAILED){
+		return -1;
+	}
+	int count = Haptics_register_bank(bank, st.st_size);
+	munmap(bank, st.st_size);
+	return count;
+#endif
+}
+
+#ifdef __linux__
+// Read a bank into memory and register it. Unlike a mapping, a copy cannot fault if the file is rewritten while it is read.
+static int Haptics_reload_bank(const char *path){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		return -1;
+	}
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(HapticsBankHeader))){
+		close(fd);
+		return -1;
+	}
+	size_t size = st.st_size;
+	char *bank = malloc(size);
+	size_t done = 0;
+	while(bank && (done < size)){
+		ssize_t n = read(fd, bank + done, size - done);
+		if(n <= 0){
+			break;
+		}
+		done += n;
+	}
+	close(fd);
+	// a file truncated under the read is invalid and keeps the effects as they are
+	int count = (bank && (done == size)) ? Haptics_register_bank(bank, size) : -1;
+	free(bank);
+	return count;
+}
+#endif
+
+// Reload the watched bank if it was written since the last poll.
+static void Haptics_watch_poll(){
+#ifdef __linux__
+	union {
+		struct inotify_event event;
+		char bytes[4096];
+	} events;
+	int changed = 0;
+	ssize_t length;
+	while((length = read(haptics.watch->fd, events.bytes, sizeof(events.bytes))) > 0){
+		for(char *at = events.bytes; at < (events.bytes + length); ){
+			struct inotify_event *event = (struct inotify_event *)at;
+			if(event->len && !strcmp(event->name, haptics.watch->name)){
+				changed = 1;
+			}
+			at += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	// a bank caught mid-write is invalid and keeps the effects as they are
+	if(changed){
+		Haptics_reload_bank(haptics.watch->path);
+	}
+#endif
+}
+
+int Haptics_watch_bank(const char *path){
+	Haptics_unwatch_bank();
+	int count = Haptics_load_bank(path);
+	if(count < 0){
+		return -1;
+	}
+#ifdef __linux__
+	size_t length = strlen(path);
+	HapticsWatch *watch = malloc(sizeof(HapticsWatch) + length + 1);
+	if(!watch){
+		return count;
+	}
+	memcpy(watch->path, path, length + 1);
+	char *slash = strrchr(watch->path, '/');
+	watch->name = slash ? (slash + 1) : watch->path;
 
-// Overall settings
+	// editors and tools often replace the file, so the directory is watched
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	int watched = -1;
+	if(watch->fd >= 0){
+		if(slash){
+			*slash = 0;
+			watched = inotify_add_watch(watch->fd, (slash == watch->path) ? "/" : watch->path, IN_CLOSE_WRITE | IN_MOVED_TO);
+			*slash = '/';
+		}
+		else{
+			watched = inotify_add_watch(watch->fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+		}
+	}
+	if(watched < 0){
+		if(watch->fd >= 0){
+			close(watch->fd);
+		}
+		free(watch);
+		return count;
+	}
+	haptics.watch = watch;
+#endif
+	return count;
+}
 
-typedef struct Haptics {
-	int enabled;
-	union SDL_HapticEffect effectDefinitions[HAPTICS_MAX_EFFECTS]; // Pre-Defined effects, identified by index
-	HapticsPlayer players[HAPTICS_MAX_PLAYERS]; // Haptic data, indexed by player
-} Haptics;
+void Haptics_unwatch_bank(){
+	if(!haptics.watch){
+		return;
+	}
+#ifdef __linux__
+	close(haptics.watch->fd);
+#endif
+	free(haptics.watch);
+	haptics.watch = NULL;
+}
 
-Haptics haptics = { .enabled = 1, .effectDefinitions = {}, .players = {} };
+// - Voice counters
+void Haptics_get_voice_stats(HapticsVoiceStats *stats){
+	*stats = haptics.voiceStats;
+}
 
+// - Effect counters and backend latencies
+int Haptics_get_stats(HapticsStats *stats){
+#ifndef HAPTICS_NO_STATS
+	stats->total = (HapticsCounters){};
+	for(int p = 0; p < haptics.max_players; p++){
+		HapticsCounters *counters = &haptics.playerCounters[p];
+		stats->total.triggers += counters->triggers;
+		for(int r = 0; r < HAPTICS_DROP_REASONS; r++){
+			stats->total.drops[r] += counters->drops[r];
+		}
+		stats->total.upload_failures += counters->upload_failures;
+		stats->total.stops += counters->stops;
+		if(stats->players && (p < stats->player_count)){
+			stats->players[p] = *counters;
+		}
+	}
+	for(int i = 0; stats->effects && (i < stats->effect_count); i++){
+		stats->effects[i] = (i < haptics.max_effects) ? haptics.effectCounters[i] : (HapticsCounters){};
+	}
+	memcpy(stats->latency, haptics.latency, sizeof(haptics.latency));
+	return 1;
+#else
+	return 0;
+#endif
+}
 
-// System management
-// - Init
-int Haptics_init(){
-	if(SDL_InitSubSystem(SDL_INIT_HAPTIC) != 0){
-		return 0;
+void Haptics_reset_stats(){
+#ifndef HAPTICS_NO_STATS
+	if(!haptics.tables){
+		return;
 	}
+	memset(haptics.playerCounters, 0, sizeof(HapticsCounters) * haptics.max_players);
+	memset(haptics.effectCounters, 0, sizeof(HapticsCounters) * haptics.max_effects);
+	memset(haptics.latency, 0, sizeof(haptics.latency));
+#endif
+}
 
-	for(int p = 0; p < HAPTICS_MAX_PLAYERS; p++){
-		for(int i = 0; i < HAPTICS_MAX_EFFECTS; i++){
-			haptics.players[p].effect[i] = -1;
+// - Command tracing
+int Haptics_set_tracing(int capacity){
+	if(haptics.trace && ((capacity <= 0) || (haptics.trace->capacity != (unsigned int)capacity))){
+		free(haptics.trace);
+		haptics.trace = NULL;
+	}
+	if((capacity > 0) && !haptics.trace){
+		HapticsTrace *trace = calloc(1, sizeof(HapticsTrace) + (sizeof(HapticsTraceEvent) * capacity));
+		if(!trace){
+			return 0;
 		}
+		trace->capacity = capacity;
+		trace->events = (HapticsTraceEvent *)(trace + 1);
+		haptics.trace = trace;
 	}
 	return 1;
 }
 
-// - Pause all
-void Haptics_pause_all(){
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			SDL_HapticPause(haptics.players[i].device);
-		}
+int Haptics_save_trace(const char *path){
+	HapticsTrace *trace = haptics.trace;
+	if(!trace){
+		return -1;
+	}
+	FILE *file = fopen(path, "w");
+	if(!file){
+		return -1;
 	}
+
+	// one track for the whole system, then one per player
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"haptics\"}}");
+	fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"system\"}}");
+	for(int p = 0; p < haptics.max_players; p++){
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"player %d\"}}", p + 1, p);
+	}
+
+	// oldest event first
+	unsigned int count = (trace->count < trace->capacity) ? trace->count : trace->capacity;
+	double scale = 1000000.0 / haptics.counterFrequency;
+	for(unsigned int n = trace->count - count; n != trace->count; n++){
+		HapticsTraceEvent *event = &trace->events[n % trace->capacity];
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"haptics\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"player\":%d,\"effect\":%d}}", haptics_trace_names[event->name], event->start * scale, event->duration * scale, event->player + 1, event->player, event->effect);
+	}
+	fprintf(file, "\n]}\n");
+
+	int failed = ferror(file);
+	if((fclose(file) != 0) || failed){
+		return -1;
+	}
+	return count;
 }
 
-void Haptics_unpause_all(){
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			SDL_HapticUnpause(haptics.players[i].device);
+// - Command capture and replay
+int Haptics_start_capture(const char *path){
+	Haptics_stop_capture();
+	HapticsCapture *capture = calloc(1, sizeof(HapticsCapture));
+	if(!capture){
+		return 0;
+	}
+	capture->file = fopen(path, "wb");
+	if(!capture->file){
+		free(capture);
+		return 0;
+	}
+	HapticsCaptureHeader header = { HAPTICS_CAPTURE_MAGIC, HAPTICS_CAPTURE_VERSION, sizeof(union SDL_HapticEffect), sizeof(HapticsStep), haptics.sizes, haptics.lazy, haptics.mixing };
+	if(fwrite(&header, sizeof(header), 1, capture->file) != 1){
+		fclose(capture->file);
+		free(capture);
+		return 0;
+	}
+	capture->last = SDL_GetPerformanceCounter();
+	haptics.capture = capture;
+
+	// the current state, for the replay to start from
+	Haptics_capture(HAPTICS_CAPTURE_SET_ENABLED, -1, -1, haptics.enabled);
+	if(haptics.hotplug){
+		Haptics_capture(HAPTICS_CAPTURE_SET_BACKGROUND_HOTPLUG, -1, -1, haptics.hotplug);
+	}
+	for(int i = 0; i < haptics.max_effects; i++){
+		if(haptics.effectDefinitions[i].type){
+			Haptics_capture_definition(HAPTICS_CAPTURE_REGISTER_EFFECT_AT, -1, haptics.effectHandles[i], &haptics.effectDefinitions[i]);
+			if(haptics.effectPriorities[i]){
+				Haptics_capture(HAPTICS_CAPTURE_SET_EFFECT_PRIORITY, -1, haptics.effectHandles[i], haptics.effectPriorities[i]);
+			}
+			if(haptics.effectRetrigger[i]){
+				Haptics_capture(HAPTICS_CAPTURE_SET_EFFECT_RETRIGGER, -1, haptics.effectHandles[i], (haptics.effectInterval[i] << 2) | haptics.effectRetrigger[i]);
+			}
+		}
+	}
+	for(int i = 0; i < haptics.sequenceCount; i++){
+		Haptics_capture_write(HAPTICS_CAPTURE_REGISTER_SEQUENCE, -1, i, haptics.sequences[i].count, &haptics.steps[haptics.sequences[i].first], sizeof(HapticsStep) * haptics.sequences[i].count);
+	}
+	for(int p = 0; p < haptics.max_players; p++){
+		Haptics_capture(HAPTICS_CAPTURE_PLAYER_LOAD_ENABLED, p, -1, haptics.players[p].enabled);
+		Haptics_capture(HAPTICS_CAPTURE_PLAYER_SET_GAIN, p, -1, haptics.players[p].gain);
+		if(Haptics_player_connected(p)){
+			Haptics_capture(HAPTICS_CAPTURE_OPEN, p, -1, 1);
 		}
 	}
+	return 1;
 }
 
-void Haptics_player_pause_all(int player){
-	SDL_HapticPause(haptics.players[player].device);
+int Haptics_stop_capture(){
+	if(!haptics.capture){
+		return 0;
+	}
+	int written = !haptics.capture->failed;
+	if(fclose(haptics.capture->file) != 0){
+		written = 0;
+	}
+	free(haptics.capture);
+	haptics.capture = NULL;
+	return written;
 }
 
-void Haptics_player_unpause_all(int player){
-	SDL_HapticUnpause(haptics.players[player].device);
+int Haptics_capture_payload_size(const HapticsCaptureRecord *record){
+	switch(record->op){
+		case HAPTICS_CAPTURE_REGISTER_EFFECT:
+		case HAPTICS_CAPTURE_REGISTER_EFFECT_AT:
+		case HAPTICS_CAPTURE_SET_EFFECT:
+		case HAPTICS_CAPTURE_PLAYER_UPDATE_EFFECT:
+			return sizeof(union SDL_HapticEffect);
+		case HAPTICS_CAPTURE_REGISTER_SEQUENCE:
+			// a corrupt step count must not overflow the size
+			if(record->value > (INT_MAX / sizeof(HapticsStep))){
+				return -1;
+			}
+			return sizeof(HapticsStep) * record->value;
+	}
+	return 0;
 }
 
-// - Stop all
-void Haptics_stop_all(){
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			SDL_HapticStopAll(haptics.players[i].device);
+int Haptics_replay_record(const HapticsCaptureRecord *record, const void *payload, SDL_Joystick *joystick){
+	// definitions are copied out of the payload, which need not be aligned
+	union SDL_HapticEffect definition;
+	int size = Haptics_capture_payload_size(record);
+	if(size < 0){
+		return -1;
+	}
+	if(size == sizeof(union SDL_HapticEffect)){
+		memcpy(&definition, payload, sizeof(definition));
+	}
+	// records of a corrupt or mismatched capture must not reach outside the player table
+	if((record->player != -1) && !Haptics_player_valid(record->player)){
+		return -1;
+	}
+	switch(record->op){
+		case HAPTICS_CAPTURE_REGISTER_EFFECT:
+			return Haptics_register_effect(&definition);
+		case HAPTICS_CAPTURE_REGISTER_EFFECT_AT:
+			Haptics_register_effect_at(&definition, record->effect);
+			break;
+		case HAPTICS_CAPTURE_REMOVE_EFFECT:
+			Haptics_remove_effect(record->effect);
+			break;
+		case HAPTICS_CAPTURE_SET_EFFECT:
+			Haptics_set_effect(&definition, record->effect);
+			break;
+		case HAPTICS_CAPTURE_SET_EFFECT_PRIORITY:
+			Haptics_set_effect_priority(record->effect, (Sint32)record->value);
+			break;
+		case HAPTICS_CAPTURE_SET_EFFECT_RETRIGGER:
+			Haptics_set_effect_retrigger(record->effect, record->value & 3, record->value >> 2);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_RUN_EFFECT:
+			Haptics_player_run_effect(record->player, record->effect, record->value);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_UPDATE_EFFECT:
+			Haptics_player_update_effect(record->player, record->effect, &definition);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_STOP_EFFECT:
+			Haptics_player_stop_effect(record->player, record->effect);
+			break;
+		case HAPTICS_CAPTURE_REGISTER_SEQUENCE: {
+			HapticsStep *steps = malloc(sizeof(HapticsStep) * record->value);
+			if(!steps){
+				return -1;
+			}
+			memcpy(steps, payload, sizeof(HapticsStep) * record->value);
+			int sequence = Haptics_register_sequence(steps, record->value);
+			free(steps);
+			return sequence;
 		}
+		case HAPTICS_CAPTURE_PLAYER_RUN_SEQUENCE:
+			Haptics_player_run_sequence(record->player, record->effect, record->value);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_STOP_SEQUENCE:
+			Haptics_player_stop_sequence(record->player, record->effect);
+			break;
+		case HAPTICS_CAPTURE_UPDATE:
+			Haptics_update(record->value);
+			break;
+		case HAPTICS_CAPTURE_PAUSE_ALL:
+			Haptics_pause_all();
+			break;
+		case HAPTICS_CAPTURE_UNPAUSE_ALL:
+			Haptics_unpause_all();
+			break;
+		case HAPTICS_CAPTURE_PLAYER_PAUSE_ALL:
+			Haptics_player_pause_all(record->player);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_UNPAUSE_ALL:
+			Haptics_player_unpause_all(record->player);
+			break;
+		case HAPTICS_CAPTURE_STOP_ALL:
+			Haptics_stop_all();
+			break;
+		case HAPTICS_CAPTURE_PLAYER_STOP_ALL:
+			Haptics_player_stop_all(record->player);
+			break;
+		case HAPTICS_CAPTURE_SET_ENABLED:
+			Haptics_set_enabled(record->value);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_SET_ENABLED:
+			Haptics_player_set_enabled(record->player, record->value);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_LOAD_ENABLED:
+			haptics.players[record->player].enabled = record->value;
+			Haptics_player_refresh(record->player);
+			break;
+		case HAPTICS_CAPTURE_PLAYER_SET_GAIN:
+			Haptics_player_set_gain(record->player, (Sint32)record->value);
+			break;
+		case HAPTICS_CAPTURE_OPEN:
+			return Haptics_open_joystick_for_player(joystick, record->player);
+		case HAPTICS_CAPTURE_CLOSE:
+			Haptics_close_for_player(record->player);
+			break;
+		case HAPTICS_CAPTURE_CLOSE_ALL:
+			Haptics_close();
+			break;
+		case HAPTICS_CAPTURE_SET_LAZY_UPLOAD:
+			Haptics_set_lazy_upload(record->value);
+			break;
+		case HAPTICS_CAPTURE_SET_MIXING:
+			Haptics_set_mixing(record->value);
+			break;
+		case HAPTICS_CAPTURE_SET_BACKGROUND_HOTPLUG:
+			Haptics_set_background_hotplug(record->value);
+			break;
 	}
+	return 0;
 }
 
-void Haptics_player_stop_all(int player){
-	SDL_HapticStopAll(haptics.players[player].device);
+
+// Effect application / control
+
+// - Apply an effect to player
+// - Count a trigger dropped before it reaches the player
+static inline void Haptics_player_count_drop(int player, int effect){
+	// the player fields behind the bitmap are only read to count why a trigger is dropped
+	if(!(haptics.enabled && haptics.players[player].enabled)){
+		HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_DISABLED]);
+	}
+	else if(!Haptics_player_connected(player)){
+		HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_DISCONNECTED]);
+	}
+	else{
+		HAPTICS_COUNT(player, -1, drops[HAPTICS_DROP_INVALID]);
+	}
 }
 
-// - Cleanup
-void Haptics_close(){
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			SDL_HapticStopAll(haptics.players[i].device);
-			SDL_HapticClose(haptics.players[i].device);
-			haptics.players[i].device = NULL;
+// - Start an effect index on a playable player, at a sequence step gain below the maximum
+static void Haptics_player_start(int player, int effect, Uint32 iterations, int gain){
+	// retriggers are settled on timestamps before any device call, and noted only once the effect has started
+	if(haptics.effectRetrigger[effect] && !Haptics_player_retrigger(player, effect)){
+		haptics.voiceStats.suppressed++;
+		HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_RETRIGGER]);
+		return;
+	}
+	if(haptics.players[player].mixing){
+		int mixed = Haptics_player_mix_effect(player, effect, iterations, gain);
+		if(mixed <= 0){
+			HAPTICS_COUNT(player, effect, drops[mixed ? HAPTICS_DROP_NOT_UPLOADED : HAPTICS_DROP_VOICES]);
+			return;
+		}
+		if(haptics.effectRetrigger[effect]){
+			Haptics_player_retriggered(player, effect, iterations);
+		}
+		// rumble is pushed right away, there is no device effect to wait on
+		if(haptics.players[player].rumble){
+			Haptics_player_mix(player, SDL_GetTicks());
+		}
+		return;
+	}
+
+	// apply a step gain on top of the player gain, or restore the definition an earlier step gain altered
+	if(gain < HAPTICS_MAX_GAIN){
+		union SDL_HapticEffect scaled;
+		Haptics_scale_effect(&scaled, Haptics_player_definition(player, effect), gain);
+		if(haptics.players[player].effect[effect] < 0){
+			Haptics_player_upload_effect(player, effect, &scaled);
+		}
+		else{
+			Haptics_player_replace_effect(player, effect, &scaled, 0);
+		}
+		haptics.players[player].altered[effect] = (haptics.players[player].effect[effect] >= 0);
+	}
+	else if(haptics.players[player].altered[effect] && (haptics.players[player].effect[effect] >= 0)){
+		Haptics_player_replace_effect(player, effect, Haptics_player_definition(player, effect), 0);
+	}
+
+	if(haptics.players[player].effect[effect] < 0){
+		// upload on first use
+		if(!haptics.lazy || !haptics.effectDefinitions[effect].type || !Haptics_player_upload_effect(player, effect, Haptics_player_definition(player, effect))){
+			HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_NOT_UPLOADED]);
+			return;
 		}
 	}
+	else{
+		haptics.players[player].used[effect] = ++haptics.players[player].clock;
+	}
+	if(!Haptics_player_claim_voice(player, effect, iterations)){
+		HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_VOICES]);
+		return;
+	}
+	if(Haptics_device_call(HAPTICS_COMMAND_RUN, player, effect, iterations) < 0){
+		// the device plays nothing, so nothing holds the voice
+		Haptics_player_release_voice(player, effect);
+		HAPTICS_COUNT(player, effect, drops[HAPTICS_DROP_DEVICE]);
+		return;
+	}
+	if(haptics.effectRetrigger[effect]){
+		Haptics_player_retriggered(player, effect, iterations);
+	}
 }
 
-// - Change settings
-void Haptics_set_enabled(int value){
-	haptics.enabled = value;
-	// if haptics are disabled, make sure that they are stopped.
-	if(!value){
-		Haptics_stop_all();
+static void Haptics_player_run(int player, int effect, Uint32 iterations, int gain){
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	effect = Haptics_effect_index(effect);
+	HAPTICS_COUNT(player, effect, triggers);
+	if(!(haptics.playable[player / 32] & (1u << (player % 32))) || (effect < 0)){
+		Haptics_player_count_drop(player, effect);
+		return;
 	}
+	haptics.effectUsed[effect] = ++haptics.clock;
+	Haptics_player_start(player, effect, iterations, gain);
 }
 
-void Haptics_player_set_enabled(int player, int value){
-	haptics.players[player].enabled = value;
-	// if haptics are disabled, make sure that they are stopped.
-	if(!value){
-		Haptics_player_stop_all(player);
+// - Restart extended effects that have ended
+static void Haptics_restart_extended(){
+	Uint32 now = SDL_GetTicks();
+	int words = (haptics.max_effects + 31) / 32;
+	for(int p = 0; (p < haptics.max_players) && haptics.extending; p++){
+		for(int w = 0; w < words; w++){
+			Uint32 bits = haptics.players[p].extending[w];
+			while(bits){
+				int effect = (w * 32) + Haptics_lowest_bit(bits);
+				bits &= bits - 1;
+				Uint32 at = haptics.players[p].retrigger[effect];
+				if((Sint32)(now - at) < 0){
+					continue;
+				}
+				Haptics_player_reset_retrigger(p, effect);
+				if(haptics.playable[p / 32] & (1u << (p % 32))){
+					Haptics_player_start(p, effect, 1, HAPTICS_MAX_GAIN);
+				}
+			}
+		}
 	}
 }
 
-void Haptics_player_set_gain(int player, int value){
-	haptics.players[player].gain = value;
+void Haptics_player_run_effect(int player, int effect, Uint32 iterations){
+	// iterations of 0 would read as a stop once queued, and run nothing anyway
+	if(Haptics_trigger_foreign()){
+		if(iterations){
+			Haptics_trigger_push(player, effect, iterations);
+		}
+		return;
+	}
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_RUN_EFFECT, player, effect, iterations);
+	Uint64 start = Haptics_trace_begin();
+	Haptics_player_run(player, effect, iterations, HAPTICS_MAX_GAIN);
+	Haptics_trace_end(HAPTICS_TRACE_RUN, player, effect, start);
 }
 
-// - Load settings
-void Haptics_settings_load(config_get_int_t get_int){
-	if(!get_int){
+// - Update an applied effect on a specific player
+static void Haptics_player_update(int player, int effect, union SDL_HapticEffect *sdlHapticEffect){
+	if(!Haptics_player_valid(player)){
 		return;
 	}
-	char configkey[32] = {'\0'};
-	int value = 0;
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		snprintf(configkey, 32, "haptics_player_%d_enabled", i);
-		if(get_int(&configkey[0], &value)){
-			haptics.players[i].enabled = value;
-		}
-		snprintf(configkey, 32, "haptics_player_%d_gain", i);
-		if(get_int(&configkey[0], &value)){
-			haptics.players[i].gain = value;
-		}
+	// mixed effects are read from the registered definitions
+	if(!haptics.players[player].device || (effect < 0) || haptics.players[player].mixing){
+		return;
+	}
+
+	union SDL_HapticEffect scaled;
+	if(haptics.players[player].scaled){
+		Haptics_scale_effect(&scaled, sdlHapticEffect, haptics.players[player].gain);
+		sdlHapticEffect = &scaled;
+	}
+
+	if(haptics.players[player].effect[effect] < 0){
+		Haptics_player_upload_effect(player, effect, sdlHapticEffect);
+		return;
 	}
+	Haptics_player_replace_effect(player, effect, sdlHapticEffect, (haptics.effectDefinitions[effect].type != sdlHapticEffect->type));
 }
 
-// - Save settings
-void Haptics_settings_save(config_set_int_t set_int){
-	if(!set_int){
+void Haptics_player_update_effect(int player, int effect, union SDL_HapticEffect *sdlHapticEffect){
+	Haptics_capture_definition(HAPTICS_CAPTURE_PLAYER_UPDATE_EFFECT, player, effect, sdlHapticEffect);
+	Haptics_player_update(player, Haptics_effect_index(effect), sdlHapticEffect);
+}
+
+// - Stop effect on a player
+static void Haptics_player_stop(int player, int effect){
+	if(!Haptics_player_valid(player)){
+		return;
+	}
+	effect = Haptics_effect_index(effect);
+	if(effect >= 0){
+		HAPTICS_COUNT(player, effect, stops);
+		// a stopped effect may start again, though not sooner than its interval
+		if(haptics.effectRetrigger[effect] != HAPTICS_RETRIGGER_INTERVAL){
+			Haptics_player_reset_retrigger(player, effect);
+		}
+	}
+	if(haptics.players[player].mixing && (effect >= 0)){
+		Haptics_player_unmix_effect(player, effect);
+		if(haptics.players[player].rumble){
+			Haptics_player_mix(player, SDL_GetTicks());
+		}
 		return;
 	}
-	char configkey[32] = {'\0'};
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		snprintf(configkey, 32, "haptics_player_%d_enabled", i);
-		set_int(&configkey[0], haptics.players[i].enabled);
+	if(haptics.players[player].device && (effect >= 0) && (haptics.players[player].effect[effect] >= 0) ){
+		Haptics_device_call(HAPTICS_COMMAND_STOP, player, effect, 0);
+		Haptics_player_release_voice(player, effect);
+	}
+}
 
-		snprintf(configkey, 32, "haptics_player_%d_gain", i);
-		set_int(&configkey[0], haptics.players[i].gain);
+void Haptics_player_stop_effect(int player, int effect){
+	if(Haptics_trigger_foreign()){
+		Haptics_trigger_push(player, effect, 0);
+		return;
 	}
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_STOP_EFFECT, player, effect, 0);
+	Uint64 start = Haptics_trace_begin();
+	Haptics_player_stop(player, effect);
+	Haptics_trace_end(HAPTICS_TRACE_STOP, player, effect, start);
 }
 
-// - Haptic Device Detection - call on device add / remove
-// - Application of effects to devices - on device add
-int Haptics_open_joystick_for_player(SDL_Joystick *joystick, int player){
-	haptics.players[player].device = SDL_HapticOpenFromJoystick(joystick);
-	if(!haptics.players[player].device){
+// - Effect can be run on a player without an upload
+int Haptics_player_effect_ready(int player, int effect){
+	if(!Haptics_player_valid(player)){
+		return 0;
+	}
+	effect = Haptics_effect_index(effect);
+	if((effect < 0) || !Haptics_player_connected(player) || !haptics.effectDefinitions[effect].type){
 		return 0;
 	}
+	// mixed effects are read from the registered definitions
+	if(haptics.players[player].mixing){
+		return 1;
+	}
+	return haptics.players[player].effect[effect] >= 0;
+}
 
-	// try to appply registered effects
-	for(int i = 0; i < HAPTICS_MAX_EFFECTS; i++){
-		haptics.players[player].effect[i] = SDL_HapticNewEffect(haptics.players[player].device, &haptics.effectDefinitions[i]);
+
+// Player groups
+// - Players of a mask that exist
+static inline Uint32 Haptics_players_mask(Uint32 player_mask){
+	if(haptics.max_players < 32){
+		player_mask &= (1u << haptics.max_players) - 1;
 	}
+	return player_mask;
+}
 
-	return 1;
+// - Connected players of a clipped mask, none before the player table exists
+static inline Uint32 Haptics_players_connected(Uint32 players){
+	return players ? (players & haptics.connected[0]) : 0;
 }
 
-int Haptics_close_for_player(int player){
-	SDL_HapticClose(haptics.players[player].device);
-	haptics.players[player].device = 0;
+// - Capture a call on a group of players as the equivalent call on each player
+static void Haptics_capture_mask(int op, Uint32 player_mask, int effect, Uint32 value){
+	if(!haptics.capture){
+		return;
+	}
+	for(Uint32 bits = Haptics_players_mask(player_mask); bits; bits &= bits - 1){
+		Haptics_capture(op, Haptics_lowest_bit(bits), effect, value);
+	}
+}
 
-	// clear registered effects
-	for(int i = 0; i < HAPTICS_MAX_EFFECTS; i++){
-		haptics.players[player].effect[i] = -1;
+void Haptics_run_effect_mask(Uint32 player_mask, int effect, Uint32 iterations){
+	Uint32 players = Haptics_players_mask(player_mask);
+	if(Haptics_trigger_foreign()){
+		for(Uint32 bits = players; bits && iterations; bits &= bits - 1){
+			Haptics_trigger_push(Haptics_lowest_bit(bits), effect, iterations);
+		}
+		return;
+	}
+	Haptics_capture_mask(HAPTICS_CAPTURE_PLAYER_RUN_EFFECT, players, effect, iterations);
+	Uint64 start = Haptics_trace_begin();
+	int index = Haptics_effect_index(effect);
+	Uint32 playable = (index >= 0) ? (players & haptics.playable[0]) : 0;
+#ifndef HAPTICS_NO_STATS
+	for(Uint32 bits = players; bits; bits &= bits - 1){
+		int player = Haptics_lowest_bit(bits);
+		HAPTICS_COUNT(player, index, triggers);
+		if(!(playable & (1u << player))){
+			Haptics_player_count_drop(player, index);
+		}
+	}
+#endif
+	if(playable){
+		haptics.effectUsed[index] = ++haptics.clock;
+		Haptics_queue_hold(1);
+		for(Uint32 bits = playable; bits; bits &= bits - 1){
+			Haptics_player_start(Haptics_lowest_bit(bits), index, iterations, HAPTICS_MAX_GAIN);
+		}
+		Haptics_queue_hold(-1);
 	}
+	Haptics_trace_end(HAPTICS_TRACE_RUN, -1, effect, start);
+}
 
-	return 1;
+void Haptics_stop_effect_mask(Uint32 player_mask, int effect){
+	Uint32 players = Haptics_players_mask(player_mask);
+	if(Haptics_trigger_foreign()){
+		for(Uint32 bits = players; bits; bits &= bits - 1){
+			Haptics_trigger_push(Haptics_lowest_bit(bits), effect, 0);
+		}
+		return;
+	}
+	Haptics_capture_mask(HAPTICS_CAPTURE_PLAYER_STOP_EFFECT, players, effect, 0);
+	Uint64 start = Haptics_trace_begin();
+	Haptics_queue_hold(1);
+	for(Uint32 bits = Haptics_players_connected(players); bits; bits &= bits - 1){
+		Haptics_player_stop(Haptics_lowest_bit(bits), effect);
+	}
+	Haptics_queue_hold(-1);
+	Haptics_trace_end(HAPTICS_TRACE_STOP, -1, effect, start);
 }
 
+void Haptics_pause_mask(Uint32 player_mask){
+	Uint32 players = Haptics_players_mask(player_mask);
+	Haptics_capture_mask(HAPTICS_CAPTURE_PLAYER_PAUSE_ALL, players, -1, 0);
+	Haptics_queue_hold(1);
+	for(Uint32 bits = Haptics_players_connected(players); bits; bits &= bits - 1){
+		int player = Haptics_lowest_bit(bits);
+		Haptics_device_call(HAPTICS_COMMAND_PAUSE, player, 0, 0);
+		haptics.players[player].paused = 1;
+	}
+	Haptics_queue_hold(-1);
+}
 
-// Effect definition / management
+void Haptics_unpause_mask(Uint32 player_mask){
+	Uint32 players = Haptics_players_mask(player_mask);
+	Haptics_capture_mask(HAPTICS_CAPTURE_PLAYER_UNPAUSE_ALL, players, -1, 0);
+	Haptics_queue_hold(1);
+	for(Uint32 bits = Haptics_players_connected(players); bits; bits &= bits - 1){
+		int player = Haptics_lowest_bit(bits);
+		Haptics_device_call(HAPTICS_COMMAND_UNPAUSE, player, 0, 0);
+		Haptics_player_resume(player);
+	}
+	Haptics_queue_hold(-1);
+}
 
-// - Register and get reference for effect
-int Haptics_register_effect(union SDL_HapticEffect *sdlHapticEffect){
-	int effect = 0;
-	while((effect < HAPTICS_MAX_EFFECTS) && haptics.effectDefinitions[effect].type){
-		effect++;
+void Haptics_update_effect_mask(Uint32 player_mask, int effect, union SDL_HapticEffect *sdlHapticEffect){
+	Uint32 players = Haptics_players_mask(player_mask);
+	if(haptics.capture){
+		for(Uint32 bits = players; bits; bits &= bits - 1){
+			Haptics_capture_definition(HAPTICS_CAPTURE_PLAYER_UPDATE_EFFECT, Haptics_lowest_bit(bits), effect, sdlHapticEffect);
+		}
 	}
+	int index = Haptics_effect_index(effect);
+	Haptics_queue_hold(1);
+	for(Uint32 bits = Haptics_players_connected(players); bits; bits &= bits - 1){
+		Haptics_player_update(Haptics_lowest_bit(bits), index, sdlHapticEffect);
+	}
+	Haptics_queue_hold(-1);
+}
 
-	if(effect >= HAPTICS_MAX_EFFECTS){
+
+// Sequences
+
+// - Register a sequence of effect steps
+int Haptics_register_sequence(const HapticsStep *steps, int count){
+	if((count <= 0) || (haptics.sequenceCount >= haptics.sizes.max_sequences) || (count > (haptics.sizes.max_sequence_steps - haptics.stepCount))){
 		return -1;
 	}
-	haptics.effectDefinitions[effect] = *sdlHapticEffect;
 
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			haptics.players[i].effect[effect] = SDL_HapticNewEffect(haptics.players[i].device, sdlHapticEffect);
-		}
+	HapticsSequence *sequence = &haptics.sequences[haptics.sequenceCount];
+	sequence->first = haptics.stepCount;
+	sequence->count = count;
+	for(int i = 0; i < count; i++){
+		haptics.steps[sequence->first + i] = steps[i];
 	}
-	return effect;
+	haptics.stepCount += count;
+	if(haptics.capture){
+		Haptics_capture_write(HAPTICS_CAPTURE_REGISTER_SEQUENCE, -1, haptics.sequenceCount, count, steps, sizeof(HapticsStep) * count);
+	}
+	return haptics.sequenceCount++;
 }
 
-void Haptics_register_effect_at(union SDL_HapticEffect *sdlHapticEffect, int id){
-	if(id >= HAPTICS_MAX_EFFECTS){
+// - Run a sequence step on a player
+static void Haptics_player_run_step(int player, HapticsStep *step){
+	if(!(haptics.enabled && haptics.players[player].enabled && Haptics_player_connected(player))){
 		return;
 	}
-	haptics.effectDefinitions[id] = *sdlHapticEffect;
-
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			haptics.players[i].effect[id] = SDL_HapticNewEffect(haptics.players[i].device, sdlHapticEffect);
-		}
+	int effect = Haptics_effect_index(step->effect);
+	if((effect < 0) || !haptics.effectDefinitions[effect].type){
+		return;
 	}
+	// steps are replayed by the update or sequence run that made them, so they are not captured
+	Uint64 start = Haptics_trace_begin();
+	Haptics_player_run(player, step->effect, step->iterations, ((step->gain > 0) && (step->gain < HAPTICS_MAX_GAIN)) ? step->gain : HAPTICS_MAX_GAIN);
+	Haptics_trace_end(HAPTICS_TRACE_RUN, player, step->effect, start);
 }
 
-// - Delete an effect
-void Haptics_remove_effect(int effect){
-	if(haptics.effectDefinitions[effect].type){
-		haptics.effectDefinitions[effect].type = 0;
-	}
+// - Run the due steps of a timeline, returning 0 once it has finished
+static int Haptics_timeline_advance(HapticsTimeline *timeline, Uint32 now){
+	HapticsSequence *sequence = &haptics.sequences[timeline->sequence];
+	// at most one pass over the sequence per update, so sequences without delays cannot stall it
+	for(int run = 0; run < sequence->count; run++){
+		if((Sint32)(now - timeline->next) < 0){
+			return 1;
+		}
+		Haptics_player_run_step(timeline->player, &haptics.steps[sequence->first + timeline->step]);
 
-	// unregister effect from devices
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device && (haptics.players[i].effect[effect] >= 0) ){
-			SDL_HapticDestroyEffect(haptics.players[i].device, haptics.players[i].effect[effect]);
-			haptics.players[i].effect[effect] = -1;
+		timeline->step++;
+		if(timeline->step >= sequence->count){
+			if(timeline->iterations != SDL_HAPTIC_INFINITY){
+				timeline->iterations--;
+				if(!timeline->iterations){
+					return 0;
+				}
+			}
+			timeline->step = 0;
 		}
+		timeline->next += haptics.steps[sequence->first + timeline->step].delay;
 	}
+	return 1;
 }
 
-// - Modify an effect
-void Haptics_set_effect(union SDL_HapticEffect *sdlHapticEffect, int effect){
-	haptics.effectDefinitions[effect] = *sdlHapticEffect;
+// - Remove a timeline, moving the last timeline into its place
+static void Haptics_timeline_remove(int timeline){
+	haptics.timelines[timeline] = haptics.timelines[--haptics.timelineCount];
+}
 
-	for(int i = 0; i < HAPTICS_MAX_PLAYERS; i++){
-		if(haptics.players[i].device){
-			haptics.players[i].effect[effect] = SDL_HapticNewEffect(haptics.players[i].device, sdlHapticEffect);
-			if(haptics.players[i].effect[effect] < 0){
-				printf("Unable to register effect %d with player %d\n", effect, i);
-			}
+// Stop all sequences playing on a player.
+static void Haptics_player_clear_timelines(int player){
+	for(int i = 0; i < haptics.timelineCount; ){
+		if(haptics.timelines[i].player == player){
+			Haptics_timeline_remove(i);
+		}
+		else{
+			i++;
 		}
 	}
 }
 
+// - Play a sequence on a player
+int Haptics_player_run_sequence(int player, int sequence, Uint32 iterations){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_RUN_SEQUENCE, player, sequence, iterations);
+	if(!Haptics_player_valid(player)){
+		return 0;
+	}
+	if((sequence < 0) || (sequence >= haptics.sequenceCount) || (haptics.timelineCount >= haptics.sizes.max_timelines)){
+		return 0;
+	}
 
-// Effect application / control
+	HapticsTimeline *timeline = &haptics.timelines[haptics.timelineCount];
+	timeline->player = player;
+	timeline->sequence = sequence;
+	timeline->step = 0;
+	timeline->iterations = iterations ? iterations : 1;
+	timeline->next = haptics.now + haptics.steps[haptics.sequences[sequence].first].delay;
+	haptics.timelineCount++;
 
-// - Apply an effect to player
-void Haptics_player_run_effect(int player, int effect, Uint32 iterations){
-	if(haptics.enabled && haptics.players[player].enabled && haptics.players[player].device && (haptics.players[player].effect[effect] >= 0) ){
-		SDL_HapticRunEffect(haptics.players[player].device, haptics.players[player].effect[effect], iterations);
+	if(!Haptics_timeline_advance(timeline, haptics.now)){
+		Haptics_timeline_remove(haptics.timelineCount - 1);
 	}
+	return 1;
 }
 
-// - Update an applied effect on a specific player
-void Haptics_player_update_effect(int player, int effect, union SDL_HapticEffect *sdlHapticEffect){}
+// - Stop a sequence on a player
+void Haptics_player_stop_sequence(int player, int sequence){
+	Haptics_capture(HAPTICS_CAPTURE_PLAYER_STOP_SEQUENCE, player, sequence, 0);
+	for(int i = 0; i < haptics.timelineCount; ){
+		if((haptics.timelines[i].player == player) && (haptics.timelines[i].sequence == sequence)){
+			Haptics_timeline_remove(i);
+		}
+		else{
+			i++;
+		}
+	}
+}
 
-// - Stop effect on a player
-void Haptics_player_stop_effect(int player, int effect){
-	if(haptics.players[player].device && (haptics.players[player].effect[effect] >= 0) ){
-		SDL_HapticStopEffect(haptics.players[player].device, haptics.players[player].effect[effect]);
+// - Advance all playing sequences
+void Haptics_update(Uint32 now_ms){
+	Haptics_capture(HAPTICS_CAPTURE_UPDATE, -1, -1, now_ms);
+	if(haptics.watch){
+		Haptics_watch_poll();
+	}
+	haptics.now = now_ms;
+	if(!haptics.ticking){
+		haptics.ticking = 1;
+		for(int i = 0; i < haptics.timelineCount; i++){
+			haptics.timelines[i].next += now_ms;
+		}
+	}
+	if(haptics.threads){
+		Haptics_trigger_drain(haptics.threads);
+	}
+	for(int i = 0; i < haptics.timelineCount; ){
+		if(!Haptics_timeline_advance(&haptics.timelines[i], now_ms)){
+			Haptics_timeline_remove(i);
+		}
+		else{
+			i++;
+		}
+	}
+	if(haptics.extending){
+		Haptics_restart_extended();
+	}
+
+	// mixer voices are timed with the tick count, like device voices, so they also play between updates
+	Uint32 ticks = SDL_GetTicks();
+	for(int p = 0; p < haptics.max_players; p++){
+		if(haptics.players[p].mixing && !haptics.players[p].paused && Haptics_player_connected(p)){
+			Haptics_player_mix(p, ticks);
+		}
+		if(haptics.hotplug){
+			Haptics_player_collect_open(p);
+			if(haptics.players[p].uploading){
+				Haptics_player_upload_next(p, HAPTICS_UPLOADS_PER_UPDATE);
+			}
+		}
 	}
 }
 
 // Callback to open up haptics when a controller is added
 void Haptics_controller_added(int device_index, int player){
-	if(Haptics_open_joystick_for_player(SDL_JoystickFromInstanceID(SDL_JoystickGetDeviceInstanceID(device_index)), player)){
+	SDL_Joystick *joystick = SDL_JoystickFromInstanceID(SDL_JoystickGetDeviceInstanceID(device_index));
+	// the worker opens the device, the player is enabled once an update sees it opened
+	if(haptics.hotplug && haptics.queue){
+		Haptics_open_player_background(joystick, player);
+		return;
+	}
+	if(Haptics_open_joystick_for_player(joystick, player)){
 		Haptics_player_set_enabled(player, 1);
 	}
 }
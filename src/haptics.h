@@ -4,6 +4,51 @@
 #ifndef HAPTICS_H
 #define HAPTICS_H
 
+/**
+ * Haptics system instance, holding its own effects, players and settings.
+ */
+typedef struct HapticsContext HapticsContext;
+
+/**
+ * Create a haptics context.
+ *
+ * Every other function acts on the context selected by the calling thread,
+ * a default context unless Haptics_set_context was called. A new context
+ * starts with the default settings and backend, and is initialized like the
+ * default one once selected.
+ *
+ * \return The context, or NULL if out of memory.
+ */
+HapticsContext *Haptics_create_context();
+
+/**
+ * Close the devices of a context and free it.
+ *
+ * The calling thread goes back to the default context if it selected this
+ * one. Other threads must no longer use it. The default context cannot be
+ * destroyed.
+ *
+ * \param context Context created by Haptics_create_context.
+ */
+void Haptics_destroy_context(HapticsContext *context);
+
+/**
+ * Select the context the calling thread acts on.
+ *
+ * A context may be used from several threads only as async and threaded
+ * modes allow.
+ *
+ * \param context Context to select, or NULL for the default context.
+ */
+void Haptics_set_context(HapticsContext *context);
+
+/**
+ * Get the context selected by the calling thread.
+ *
+ * \return The selected context.
+ */
+HapticsContext *Haptics_get_context();
+
 /**
  * Initialize the haptics system.
  *
@@ -11,6 +56,32 @@
  */
 int Haptics_init();
 
+/**
+ * Haptics system table sizes.
+ */
+typedef struct HapticsConfig {
+	int max_players; // number of players, 0 for the default of 4
+	int max_effects; // number of registered effects, 0 for the default of 32
+	int max_sequences; // number of registered sequences, 0 for the default of 32
+	int max_sequence_steps; // steps of all registered sequences, 0 for the default of 256
+	int max_timelines; // sequences playing at once, 0 for the default of 64
+	int max_mixer_voices; // effects mixed at once per player, 0 for the default of 32
+} HapticsConfig;
+
+/**
+ * Initialize the haptics system with the specified table sizes.
+ *
+ * Player and effect tables are allocated once, here. Changing their size
+ * discards registered effects and player settings, and fails while async or
+ * batched modes are enabled. The tables are allocated even when the device
+ * subsystem fails to start, so later calls are safe and simply find no
+ * devices. Before any init, calls on players do nothing.
+ *
+ * \param config Table sizes, or NULL for the defaults.
+ * \return 1 if successful.
+ */
+int Haptics_init_with_config(const HapticsConfig *config);
+
 /**
  * Pause haptics for all players.
  */
@@ -49,6 +120,9 @@ void Haptics_player_stop_all(int player);
 
 /**
  * Close haptics system and all devices.
+ *
+ * Closing disables threaded mode, so in threaded mode other threads must
+ * stop triggering before this call.
  */
 void Haptics_close();
 
@@ -75,6 +149,150 @@ void Haptics_player_set_enabled(int player, int value);
  */
 void Haptics_player_set_gain(int player, int value);
 
+/**
+ * Set lazy effect uploading.
+ *
+ * When enabled, effects are uploaded to a device the first time they are run
+ * instead of when the device is opened. Devices keep as many effects as they
+ * have slots for and release the least recently used effect to make room.
+ * Set before opening devices.
+ *
+ * \param value Lazy upload setting value 0 or 1.
+ */
+void Haptics_set_lazy_upload(int value);
+
+/**
+ * Set software effect mixing.
+ *
+ * When enabled, devices with left/right motors play all effects through a
+ * single left/right effect. Haptics_update evaluates the envelope of every
+ * playing effect, adds them up and updates the device effect when the motor
+ * levels change. Condition and custom effects are not played on these
+ * devices. Set before opening devices.
+ *
+ * \param value Mixing setting value 0 or 1.
+ */
+void Haptics_set_mixing(int value);
+
+/**
+ * Set background controller hotplug.
+ *
+ * When enabled, devices opened without lazy upload get their effects over
+ * the following Haptics_update calls, a few per call, most recently run
+ * effects first. Until then Haptics_player_effect_ready reports them as not
+ * ready. Running one is dropped as not uploaded, rather than waiting on an
+ * upload, and moves it to the front of the uploads. In async mode,
+ * Haptics_controller_added also hands the device open to the worker
+ * thread and returns right away. The player is set up and enabled by the
+ * first Haptics_update after the open completes.
+ *
+ * \param value Background hotplug setting value 0 or 1.
+ */
+void Haptics_set_background_hotplug(int value);
+
+/**
+ * Set asynchronous device access.
+ *
+ * When enabled, device calls are queued and issued by a worker thread so
+ * triggering effects does not wait on the driver. Triggers that do not fit in
+ * the queue are dropped and counted, other device calls wait for room.
+ *
+ * \param value Async setting value 0 or 1.
+ * \return 1 if successful.
+ */
+int Haptics_set_async(int value);
+
+/**
+ * Wait until all queued device calls have been issued.
+ */
+void Haptics_sync();
+
+/**
+ * Asynchronous device access counters, since async mode was enabled.
+ */
+typedef struct HapticsAsyncStats {
+	unsigned int queued; // device calls queued
+	unsigned int pending; // device calls waiting for the worker
+	unsigned int overflows; // triggers dropped because the queue was full
+	unsigned int stalls; // waits for room in the queue
+	unsigned int failures; // device calls that failed on the worker
+} HapticsAsyncStats;
+
+/**
+ * Get asynchronous device access counters.
+ *
+ * \param stats Receives the counters.
+ */
+void Haptics_get_async_stats(HapticsAsyncStats *stats);
+
+/**
+ * Set batched device access.
+ *
+ * When enabled, effect runs, stops and updates are collected until
+ * Haptics_flush is called, typically once per frame. Repeated commands for
+ * the same player and effect are merged into one device call, and a run
+ * followed by a stop is cancelled, leaving only the stop.
+ *
+ * \param value Batched setting value 0 or 1.
+ * \return 1 if successful.
+ */
+int Haptics_set_batched(int value);
+
+/**
+ * Issue all device calls collected in batched mode.
+ */
+void Haptics_flush();
+
+/**
+ * Batched device access counters, since batched mode was enabled.
+ */
+typedef struct HapticsBatchStats {
+	unsigned int queued; // device calls collected
+	unsigned int coalesced; // device calls merged into an earlier call
+	unsigned int cancelled; // runs cancelled by a stop in the same frame
+	unsigned int flushed; // device calls issued by flushes
+} HapticsBatchStats;
+
+/**
+ * Get batched device access counters.
+ *
+ * \param stats Receives the counters.
+ */
+void Haptics_get_batch_stats(HapticsBatchStats *stats);
+
+/**
+ * Set triggering from any thread.
+ *
+ * When enabled, the thread making this call owns the haptics system and
+ * keeps calling Haptics_update and every other function. Other threads may
+ * call Haptics_player_run_effect and Haptics_player_stop_effect: their
+ * triggers are checked against a snapshot of the effect table and queued
+ * without taking a lock, then run by the next Haptics_update. Registering,
+ * setting and removing effects publish a new snapshot and wait until no
+ * other thread still reads the replaced one. Other threads must select the
+ * same context, and stop triggering before threaded mode is disabled.
+ *
+ * \param value Threaded setting value 0 or 1.
+ * \return 1 if successful.
+ */
+int Haptics_set_threaded(int value);
+
+/**
+ * Triggers from other threads counters, since threaded mode was enabled.
+ */
+typedef struct HapticsThreadStats {
+	unsigned int drained; // triggers run by updates
+	unsigned int overflows; // triggers dropped because the queue was full
+	unsigned int rejected; // triggers dropped for an invalid player or effect
+} HapticsThreadStats;
+
+/**
+ * Get triggers from other threads counters.
+ *
+ * \param stats Receives the counters.
+ */
+void Haptics_get_thread_stats(HapticsThreadStats *stats);
+
 /**
  * Prototype function for obtaining configuration values.
  */
@@ -89,24 +307,73 @@ void Haptics_settings_load(config_get_int_t get_int);
 
 /**
  * Prototype function for saving configuration values.
+ *
+ * Returns nonzero once the value is saved.
  */
 typedef int (config_set_int_t)(const char *key, int value);
 
 /**
- * Save haptics system settings.
+ * Save haptics system settings changed since they were last loaded or saved.
  *
  * \param set_int Function pointer for saving configuration values.
  */
 void Haptics_settings_save(config_set_int_t set_int);
 
+/**
+ * Player setting handed to batched configuration functions.
+ *
+ * Keys are "haptics_player_<player>_enabled" and "haptics_player_<player>_gain"
+ * for every player, and stay valid until the player tables are resized.
+ */
+typedef struct HapticsSetting {
+	const char *key;
+	int value;
+	int found; // set by loads for keys that have a value
+} HapticsSetting;
+
+/**
+ * Prototype function for obtaining all configuration values in one call.
+ *
+ * Sets the value and found flag of each setting with a saved value.
+ */
+typedef void (config_get_batch_t)(HapticsSetting *settings, int count);
+
+/**
+ * Load haptics system settings in one call.
+ *
+ * \param get_batch Function pointer for obtaining configuration values.
+ */
+void Haptics_settings_load_batch(config_get_batch_t get_batch);
+
+/**
+ * Prototype function for saving configuration values in one call.
+ *
+ * Returns nonzero once all the values are saved.
+ */
+typedef int (config_set_batch_t)(const HapticsSetting *settings, int count);
+
+/**
+ * Save haptics system settings changed since they were last loaded or saved,
+ * in one call. Nothing is called when no setting changed.
+ *
+ * \param set_batch Function pointer for saving configuration values.
+ */
+void Haptics_settings_save_batch(config_set_batch_t set_batch);
+
 // prototype
 typedef struct _SDL_Joystick SDL_Joystick;
 
 /**
  * Open haptics device on joystick for specified player.
  *
+ * Joysticks without a haptic device are rumbled directly when they support
+ * it, with effects mixed in software as with Haptics_set_mixing. Their
+ * effects play as soon as they are run, later changes in the mix are pushed
+ * by Haptics_update.
+ *
  * \param joystick SDL Joystick.
  * \param player Player index.
+ * \return 1 if successful.
  */
 int Haptics_open_joystick_for_player(SDL_Joystick *joystick, int player);
 
@@ -124,8 +391,12 @@ union SDL_HapticEffect;
 /**
  * Register a haptics effect.
  *
+ * The returned handle is the effect index combined with a generation count.
+ * Once the effect is removed and its slot reused, calls with the old handle
+ * are ignored.
+ *
  * \param sdlHapticsEffect SDL Haptics effect to register.
- * \return Effect index.
+ * \return Effect handle, or -1 if the effect table is full.
  */
 int Haptics_register_effect(union SDL_HapticEffect *sdlHapticEffect);
 
@@ -133,29 +404,216 @@ int Haptics_register_effect(union SDL_HapticEffect *sdlHapticEffect);
  * Register a haptics effect at a specified index.
  *
  * \param sdlHapticsEffect SDL Haptics effect to register.
- * \param id Index to register effect at.
+ * \param id Index or handle to register effect at, becoming the effect handle.
  */
 void Haptics_register_effect_at(union SDL_HapticEffect *sdlHapticEffect, int id);
 
 /**
  * Remove/unregister the haptics effect at the specified index.
  *
- * \param id Effect index.
+ * \param id Effect handle.
  */
 void Haptics_remove_effect(int effect);
 
 /**
  * Modify effect at specified index.
  *
- * \param effect Effect index.
+ * Effects already uploaded to devices are updated in place, keeping their
+ * device slot. They are only re-created when the effect type changes.
+ *
+ * \param sdlHapticEffect Modified SDL Haptics effect.
+ * \param effect Effect handle.
  */
 void Haptics_set_effect(union SDL_HapticEffect *sdlHapticEffect, int effect);
 
+/**
+ * Set the voice priority of an effect.
+ *
+ * When every effect a device can play at once is busy, running an effect
+ * stops the playing effect with the lowest priority, the oldest first, as long
+ * as its priority is not higher than the new effect's. Otherwise the new
+ * effect is not run. Effects start with priority 0.
+ *
+ * \param effect Effect handle.
+ * \param priority Priority, higher values win.
+ */
+void Haptics_set_effect_priority(int effect, int priority);
+
+/**
+ * Retrigger policies, deciding what running an effect that is already
+ * playing on a player does.
+ */
+typedef enum HapticsRetrigger {
+	HAPTICS_RETRIGGER_RESTART, // restart the effect on the device
+	HAPTICS_RETRIGGER_IGNORE, // ignore triggers until the effect ends or is stopped
+	HAPTICS_RETRIGGER_EXTEND, // ignore triggers, restarting the effect once when it ends
+	HAPTICS_RETRIGGER_INTERVAL, // ignore triggers sooner than the interval after the last start
+} HapticsRetrigger;
+
+/**
+ * Set the retrigger policy of an effect, usually right after registering it.
+ *
+ * Triggers an effect's policy turns away are settled on timestamps, without
+ * any device call, and counted as suppressed in the voice stats and as
+ * retrigger drops in the stats. An extended effect restarts for a single
+ * iteration on the first Haptics_update() after it ends. Effects start with
+ * the restart policy.
+ *
+ * \param effect Effect handle.
+ * \param policy Retrigger policy.
+ * \param interval_ms Minimum milliseconds between starts, for the interval policy, up to 2^30 - 1 when captured.
+ */
+void Haptics_set_effect_retrigger(int effect, HapticsRetrigger policy, Uint32 interval_ms);
+
+#define HAPTICS_BANK_MAGIC 0x4b4e4248 // "HBNK"
+#define HAPTICS_BANK_VERSION 1
+
+/**
+ * Header of an effect bank, followed by its entries.
+ *
+ * Banks are written in the byte order of the compiling platform, with every
+ * entry 4 byte aligned so a mapped bank is read in place.
+ */
+typedef struct HapticsBankHeader {
+	Uint32 magic; // HAPTICS_BANK_MAGIC
+	Uint32 version; // HAPTICS_BANK_VERSION
+	Uint32 count; // number of entries
+	Uint32 size; // bytes of entries following the header
+} HapticsBankHeader;
+
+typedef struct HapticsBankDirection {
+	Sint32 dir[3];
+	Uint8 type; // SDL_HAPTIC_POLAR, SDL_HAPTIC_CARTESIAN, ...
+	Uint8 reserved[3];
+} HapticsBankDirection;
+
+typedef struct HapticsBankEnvelope {
+	Uint16 attack_length;
+	Uint16 attack_level;
+	Uint16 fade_length;
+	Uint16 fade_level;
+} HapticsBankEnvelope;
+
+/**
+ * Effect bank entry, holding only the fields its effect type uses.
+ *
+ * Custom effects, which point to their samples, cannot be banked.
+ */
+typedef struct HapticsBankEntry {
+	Uint16 type; // SDL_HAPTIC_* effect type
+	Uint16 size; // bytes to the next entry
+	Sint32 index; // index or handle to register the effect at
+	Sint32 priority; // effect priority
+	Uint32 length; // effect length in milliseconds
+	union {
+		struct {
+			Uint16 large_magnitude;
+			Uint16 small_magnitude;
+		} leftright;
+		struct {
+			HapticsBankDirection direction;
+			Uint16 delay, button, interval;
+			Sint16 level;
+			HapticsBankEnvelope envelope;
+		} constant;
+		struct {
+			HapticsBankDirection direction;
+			Uint16 delay, button, interval, period;
+			Sint16 magnitude, offset;
+			Uint16 phase, reserved;
+			HapticsBankEnvelope envelope;
+		} periodic;
+		struct {
+			HapticsBankDirection direction;
+			Uint16 delay, button, interval;
+			Sint16 start, end;
+			Uint16 reserved;
+			HapticsBankEnvelope envelope;
+		} ramp;
+		struct {
+			Uint16 delay, button, interval, reserved;
+			Uint16 right_sat[3], left_sat[3];
+			Sint16 right_coeff[3], left_coeff[3];
+			Uint16 deadband[3];
+			Sint16 center[3];
+		} condition;
+	};
+} HapticsBankEntry;
+
+/**
+ * Encode an effect as an effect bank entry.
+ *
+ * \param sdlHapticEffect SDL Haptics effect to encode.
+ * \param id Index or handle the effect is registered at when the bank is loaded.
+ * \param priority Effect priority.
+ * \param entry Entry to fill.
+ * \return Size of the entry in bytes, or 0 if the effect type cannot be banked.
+ */
+int Haptics_bank_encode(const union SDL_HapticEffect *sdlHapticEffect, int id, int priority, HapticsBankEntry *entry);
+
+/**
+ * Register every effect of an effect bank held in memory.
+ *
+ * The whole bank is checked before any effect is registered. Entries are
+ * decoded straight into effect definitions, without allocating. Effects
+ * already registered with the same definition and priority are left as
+ * they are.
+ *
+ * \param bank Bank data, 4 byte aligned.
+ * \param size Size of the bank data in bytes.
+ * \return Number of effects registered, or -1 if the bank is invalid or the haptics system is not initialized.
+ */
+int Haptics_register_bank(const void *bank, size_t size);
+
+/**
+ * Map an effect bank file, as compiled by tools/haptics_bank, and register every effect in it.
+ *
+ * \param path Bank file.
+ * \return Number of effects registered, or -1 if the file cannot be read or the bank is invalid.
+ */
+int Haptics_load_bank(const char *path);
+
+/**
+ * Load an effect bank file and reload it whenever it is written, for tuning effects while the game runs.
+ *
+ * Changes are picked up by Haptics_update without blocking. Only effects
+ * whose definition or priority changed are registered again, and changed
+ * effects are updated in place on open devices. Effects dropped from the
+ * bank stay registered. Watching uses inotify, elsewhere the bank is only
+ * loaded. Reloads read the file into memory instead of mapping it, so a bank
+ * rewritten in place fails validation rather than faulting.
+ *
+ * \param path Bank file.
+ * \return Number of effects registered, or -1 if the file cannot be read or the bank is invalid.
+ */
+int Haptics_watch_bank(const char *path);
+
+/**
+ * Stop watching the effect bank file.
+ */
+void Haptics_unwatch_bank();
+
+/**
+ * Voice scheduling counters, since the haptics system was initialized.
+ */
+typedef struct HapticsVoiceStats {
+	unsigned int steals; // playing effects stopped to make room for another
+	unsigned int rejections; // effects not run because higher priority effects were playing
+	unsigned int suppressed; // effects not run because of their retrigger policy
+} HapticsVoiceStats;
+
+/**
+ * Get voice scheduling counters.
+ *
+ * \param stats Receives the counters.
+ */
+void Haptics_get_voice_stats(HapticsVoiceStats *stats);
+
 /**
  * Run a haptic effect on the specified player.
  *
  * \param player Player index.
- * \param effect Effect index.
+ * \param effect Effect handle.
  * \param iterations Number of times to repeat the effect.
  */
 void Haptics_player_run_effect(int player, int effect, Uint32 iterations);
@@ -163,8 +621,12 @@ void Haptics_player_run_effect(int player, int effect, Uint32 iterations);
 /**
  * Update an effect for the specified player.
  *
+ * Only the player's device is changed, in place when the effect type matches
+ * the registered effect. The registered definition is restored when the
+ * effect is next re-uploaded to the device.
+ *
  * \param player Player index.
- * \param effect Effect index.
+ * \param effect Effect handle.
  * \param sdlHapticEffect Updated SDL Haptic Effect.
  */
 void Haptics_player_update_effect(int player, int effect, union SDL_HapticEffect *sdlHapticEffect);
@@ -173,13 +635,439 @@ void Haptics_player_update_effect(int player, int effect, union SDL_HapticEffect
  * Stop a specified effect for specified player.
  *
  * \param player Player index.
- * \param effect Effect index.
+ * \param effect Effect handle.
  */
 void Haptics_player_stop_effect(int player, int effect);
 
+/**
+ * Check whether an effect is on a player device, so running it plays right away.
+ *
+ * \param player Player index.
+ * \param effect Effect handle.
+ * \return 1 if the effect is ready, 0 if it is not uploaded or the player has no device.
+ */
+int Haptics_player_effect_ready(int player, int effect);
+
+/**
+ * Run a specified effect on a group of players.
+ *
+ * Equivalent to Haptics_player_run_effect on each player of the mask, with
+ * the effect and the players checked once for the whole group. In async
+ * mode the worker is woken once for all the device calls.
+ *
+ * \param player_mask Bit per player index, players 0 to 31.
+ * \param effect Effect handle.
+ * \param iterations Number of iterations.
+ */
+void Haptics_run_effect_mask(Uint32 player_mask, int effect, Uint32 iterations);
+
+/**
+ * Stop a specified effect on a group of players.
+ *
+ * \param player_mask Bit per player index, players 0 to 31.
+ * \param effect Effect handle.
+ */
+void Haptics_stop_effect_mask(Uint32 player_mask, int effect);
+
+/**
+ * Pause haptics for a group of players.
+ *
+ * \param player_mask Bit per player index, players 0 to 31.
+ */
+void Haptics_pause_mask(Uint32 player_mask);
+
+/**
+ * Resume haptics for a group of players.
+ *
+ * \param player_mask Bit per player index, players 0 to 31.
+ */
+void Haptics_unpause_mask(Uint32 player_mask);
+
+/**
+ * Update an applied effect on a group of players.
+ *
+ * \param player_mask Bit per player index, players 0 to 31.
+ * \param effect Effect handle.
+ * \param sdlHapticEffect Effect definition.
+ */
+void Haptics_update_effect_mask(Uint32 player_mask, int effect, union SDL_HapticEffect *sdlHapticEffect);
+
+/**
+ * Step of a haptic sequence.
+ */
+typedef struct HapticsStep {
+	int effect; // effect handle
+	Uint32 delay; // milliseconds after the previous step, or the sequence start
+	Uint32 iterations; // number of times to repeat the effect
+	int gain; // step gain 1 to 9, 0 for full gain
+} HapticsStep;
+
+/**
+ * Register a sequence of effects.
+ *
+ * Steps are copied into a pool shared by all sequences, sized at init.
+ *
+ * \param steps Sequence steps.
+ * \param count Number of steps.
+ * \return Sequence index, or -1 if the sequence or step pool is full.
+ */
+int Haptics_register_sequence(const HapticsStep *steps, int count);
+
+/**
+ * Play a sequence on the specified player.
+ *
+ * Steps without delay run right away, later steps are run by Haptics_update.
+ * Steps with less than full gain update the effect on the device before
+ * running it, the next full gain step of that effect restores it.
+ *
+ * \param player Player index.
+ * \param sequence Sequence index.
+ * \param iterations Number of times to play the sequence, SDL_HAPTIC_INFINITY to repeat until stopped.
+ * \return 1 if successful, 0 if too many sequences are playing.
+ */
+int Haptics_player_run_sequence(int player, int sequence, Uint32 iterations);
+
+/**
+ * Stop playing a sequence on the specified player.
+ *
+ * Effects already running are left to finish. Haptics_player_stop_all stops
+ * all of the player's sequences along with their effects.
+ *
+ * \param player Player index.
+ * \param sequence Sequence index.
+ */
+void Haptics_player_stop_sequence(int player, int sequence);
+
+/**
+ * Advance the haptics system, typically once per frame.
+ *
+ * Runs the due steps of all playing sequences. Features that work in the
+ * background also depend on this call:
+ * - reloading a watched effect bank
+ * - running effects triggered from other threads in threaded mode
+ * - restarting extended effects once they end
+ * - refreshing the software mix and the rumble of rumble-only players
+ * - setting up devices opened in background hotplug mode, and uploading
+ *   their effects a few at a time
+ *
+ * Sequence steps are timed with now_ms. Playing effects are timed with
+ * SDL_GetTicks, so effects run between updates still end on time.
+ *
+ * \param now_ms Current time in milliseconds, such as SDL_GetTicks.
+ */
+void Haptics_update(Uint32 now_ms);
+
+/**
+ * Capabilities of a device, reported by a backend when it opens the device.
+ */
+typedef struct HapticsDeviceInfo {
+	int effects; // effects the device can hold, 0 when unknown
+	int playing; // effects the device can play at once, 0 when unknown
+	unsigned int features; // SDL_HAPTIC_* feature flags
+} HapticsDeviceInfo;
+
+/**
+ * Device access functions used by the haptics system.
+ *
+ * Devices are opaque to the haptics system, effects on a device are
+ * identified by the non-negative values returned by new_effect. Every
+ * function gets the backend data pointer as its first argument. In async
+ * mode, all functions except init and open are called from the worker thread.
+ */
+typedef struct HapticsBackend {
+	void *data; // passed to every function
+	int (*init)(void *data); // 0 if successful
+	void *(*open)(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info); // NULL when the joystick has no haptic device
+	void (*close)(void *data, void *device);
+	int (*new_effect)(void *data, void *device, union SDL_HapticEffect *effect); // effect identifier, or -1
+	int (*update_effect)(void *data, void *device, int effect, union SDL_HapticEffect *definition);
+	void (*destroy_effect)(void *data, void *device, int effect);
+	int (*run_effect)(void *data, void *device, int effect, Uint32 iterations);
+	int (*stop_effect)(void *data, void *device, int effect);
+	int (*stop_all)(void *data, void *device);
+	int (*pause)(void *data, void *device);
+	int (*unpause)(void *data, void *device);
+	int (*set_gain)(void *data, void *device, int gain);
+	int (*rumble)(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms); // rumble joysticks without a haptic device
+} HapticsBackend;
+
+/**
+ * Set the backend used for device access.
+ *
+ * The backend is copied. Set before Haptics_init and before opening devices.
+ *
+ * \param backend Device access functions, or NULL for the default backend.
+ */
+void Haptics_set_backend(const HapticsBackend *backend);
+
+/**
+ * Get the backend calling SDL haptic and joystick functions, the default.
+ *
+ * Not available when built with HAPTICS_NO_SDL_HAPTIC, which makes the null
+ * backend the default instead.
+ *
+ * \return SDL backend.
+ */
+const HapticsBackend *Haptics_sdl_backend();
+
+/**
+ * Get the null backend.
+ *
+ * Every joystick opens as a device with all features and every call succeeds
+ * without doing anything, leaving only the cost of the haptics system itself.
+ *
+ * \return Null backend.
+ */
+const HapticsBackend *Haptics_null_backend();
+
+/**
+ * Backend functions, as recorded by the recording backend.
+ */
+typedef enum HapticsBackendCall {
+	HAPTICS_CALL_OPEN,
+	HAPTICS_CALL_CLOSE,
+	HAPTICS_CALL_NEW_EFFECT,
+	HAPTICS_CALL_UPDATE_EFFECT,
+	HAPTICS_CALL_DESTROY_EFFECT,
+	HAPTICS_CALL_RUN_EFFECT,
+	HAPTICS_CALL_STOP_EFFECT,
+	HAPTICS_CALL_STOP_ALL,
+	HAPTICS_CALL_PAUSE,
+	HAPTICS_CALL_UNPAUSE,
+	HAPTICS_CALL_SET_GAIN,
+	HAPTICS_CALL_RUMBLE,
+} HapticsBackendCall;
+
+/**
+ * Recorded backend call.
+ */
+typedef struct HapticsRecord {
+	HapticsBackendCall call;
+	void *device; // device, or joystick for opens and rumbles
+	int effect; // device effect identifier, returned by new effect calls
+	Uint32 value; // effect type, run iterations, gain, or low << 16 | high rumble levels
+	int result; // value returned to the haptics system
+} HapticsRecord;
+
+/**
+ * Recording backend state.
+ */
+typedef struct HapticsRecorder {
+	HapticsRecord *records; // buffer receiving the calls
+	int size; // buffer length in records
+	int count; // calls recorded
+	unsigned int dropped; // calls not recorded because the buffer was full
+	const HapticsBackend *next; // backend the calls are passed on to, NULL to behave as the null backend
+} HapticsRecorder;
+
+/**
+ * Set up a recording backend.
+ *
+ * The backend records every call into the recorder buffer before passing it
+ * on. The recorder must stay valid while the backend is in use.
+ *
+ * \param recorder Recorder with its buffer, size and next backend set.
+ * \param backend Receives the recording backend.
+ */
+void Haptics_recording_backend(HapticsRecorder *recorder, HapticsBackend *backend);
+
+/**
+ * Reasons for effect runs not reaching a device.
+ */
+typedef enum HapticsDropReason {
+	HAPTICS_DROP_DISABLED, // haptics or the player are disabled
+	HAPTICS_DROP_DISCONNECTED, // the player has no device
+	HAPTICS_DROP_INVALID, // the effect handle is stale or invalid
+	HAPTICS_DROP_NOT_UPLOADED, // the effect is not on the device and could not be uploaded
+	HAPTICS_DROP_VOICES, // higher priority effects were playing
+	HAPTICS_DROP_DEVICE, // the device refused to run the effect
+	HAPTICS_DROP_RETRIGGER, // the retrigger policy of the effect turned the trigger away
+	HAPTICS_DROP_REASONS
+} HapticsDropReason;
+
+/**
+ * Effect counters of a player or an effect.
+ */
+typedef struct HapticsCounters {
+	unsigned int triggers; // effect runs
+	unsigned int drops[HAPTICS_DROP_REASONS]; // effect runs dropped, by reason
+	unsigned int upload_failures; // effect uploads the device refused
+	unsigned int stops; // effect stops
+} HapticsCounters;
+
+#define HAPTICS_BACKEND_CALLS (HAPTICS_CALL_RUMBLE + 1)
+#define HAPTICS_LATENCY_BUCKETS 16
+
+/**
+ * Haptics system counters, since the haptics system was initialized.
+ */
+typedef struct HapticsStats {
+	HapticsCounters total; // counters of all players
+	HapticsCounters *players; // receives the counters of each player, or NULL
+	int player_count; // length of players
+	HapticsCounters *effects; // receives the counters of each effect index, or NULL
+	int effect_count; // length of effects
+	unsigned int latency[HAPTICS_BACKEND_CALLS][HAPTICS_LATENCY_BUCKETS]; // backend calls by HapticsBackendCall and duration, bucket 0 under 1 microsecond, bucket n from 2^(n-1) microseconds, the last bucket unbounded
+} HapticsStats;
+
+/**
+ * Get haptics system counters.
+ *
+ * Drops with stale or invalid handles are only counted for players. Upload
+ * failures and device drops in async mode are counted by the async counters
+ * instead. Counters are left out of builds with HAPTICS_NO_STATS.
+ *
+ * \param stats Receives the counters, with players and effects set to arrays to fill or NULL.
+ * \return 1 if successful, 0 when counters are compiled out.
+ */
+int Haptics_get_stats(HapticsStats *stats);
+
+/**
+ * Reset haptics system counters.
+ */
+void Haptics_reset_stats();
+
+/**
+ * Set command tracing.
+ *
+ * When enabled, effect runs, stops, registrations and changes, device opens
+ * and closes, and the backend calls they make are recorded with their start
+ * time and duration in a ring holding the most recent events. Backend calls
+ * made by the async worker thread are not recorded.
+ *
+ * \param capacity Number of events kept, 0 to disable tracing.
+ * \return 1 if successful.
+ */
+int Haptics_set_tracing(int capacity);
+
+/**
+ * Save the traced events as Chrome trace-event JSON.
+ *
+ * Timestamps are SDL_GetPerformanceCounter times in microseconds, so the
+ * trace lines up with engine traces using the same clock. Each player has
+ * its own track.
+ *
+ * \param path File to write.
+ * \return Number of events written, or -1 if tracing is disabled or the file cannot be written.
+ */
+int Haptics_save_trace(const char *path);
+
+#define HAPTICS_CAPTURE_MAGIC 0x43504148 // "HAPC"
+#define HAPTICS_CAPTURE_VERSION 1
+
+/**
+ * Header of a capture file.
+ *
+ * Captures are written in the byte order and structure layout of the
+ * capturing build, for replay on the same platform.
+ */
+typedef struct HapticsCaptureHeader {
+	Uint32 magic; // HAPTICS_CAPTURE_MAGIC
+	Uint32 version; // HAPTICS_CAPTURE_VERSION
+	Uint32 definition_size; // size of an SDL_HapticEffect in the capturing build
+	Uint32 step_size; // size of a HapticsStep in the capturing build
+	HapticsConfig config; // table sizes
+	Sint32 lazy; // lazy upload setting
+	Sint32 mixing; // mixing setting
+} HapticsCaptureHeader;
+
+/**
+ * Captured calls.
+ */
+typedef enum HapticsCaptureOp {
+	HAPTICS_CAPTURE_REGISTER_EFFECT, // effect is the returned handle, followed by the definition
+	HAPTICS_CAPTURE_REGISTER_EFFECT_AT, // followed by the definition
+	HAPTICS_CAPTURE_REMOVE_EFFECT,
+	HAPTICS_CAPTURE_SET_EFFECT, // followed by the definition
+	HAPTICS_CAPTURE_SET_EFFECT_PRIORITY, // value is the priority
+	HAPTICS_CAPTURE_PLAYER_RUN_EFFECT, // value is the iterations
+	HAPTICS_CAPTURE_PLAYER_UPDATE_EFFECT, // followed by the definition
+	HAPTICS_CAPTURE_PLAYER_STOP_EFFECT,
+	HAPTICS_CAPTURE_REGISTER_SEQUENCE, // effect is the returned sequence, value the step count, followed by the steps
+	HAPTICS_CAPTURE_PLAYER_RUN_SEQUENCE, // effect is the sequence, value the iterations
+	HAPTICS_CAPTURE_PLAYER_STOP_SEQUENCE, // effect is the sequence
+	HAPTICS_CAPTURE_UPDATE, // value is the time in milliseconds
+	HAPTICS_CAPTURE_PAUSE_ALL,
+	HAPTICS_CAPTURE_UNPAUSE_ALL,
+	HAPTICS_CAPTURE_PLAYER_PAUSE_ALL,
+	HAPTICS_CAPTURE_PLAYER_UNPAUSE_ALL,
+	HAPTICS_CAPTURE_STOP_ALL,
+	HAPTICS_CAPTURE_PLAYER_STOP_ALL,
+	HAPTICS_CAPTURE_SET_ENABLED, // value is the setting
+	HAPTICS_CAPTURE_PLAYER_SET_ENABLED, // value is the setting
+	HAPTICS_CAPTURE_PLAYER_LOAD_ENABLED, // value is the setting, loaded by Haptics_settings_load
+	HAPTICS_CAPTURE_PLAYER_SET_GAIN, // value is the setting
+	HAPTICS_CAPTURE_OPEN, // value is the result
+	HAPTICS_CAPTURE_CLOSE,
+	HAPTICS_CAPTURE_CLOSE_ALL,
+	HAPTICS_CAPTURE_SET_EFFECT_RETRIGGER, // value is the interval shifted left by 2, ored with the policy
+	HAPTICS_CAPTURE_SET_LAZY_UPLOAD, // value is the setting
+	HAPTICS_CAPTURE_SET_MIXING, // value is the setting
+	HAPTICS_CAPTURE_SET_BACKGROUND_HOTPLUG, // value is the setting
+} HapticsCaptureOp;
+
+/**
+ * Captured call, followed by its definition or steps for some calls.
+ */
+typedef struct HapticsCaptureRecord {
+	Uint32 delta_us; // microseconds since the previous record
+	Uint16 op; // HapticsCaptureOp
+	Sint16 player; // player index, -1 for the whole system
+	Sint32 effect; // effect handle or sequence index, -1 when none
+	Uint32 value; // call specific value
+} HapticsCaptureRecord;
+
+/**
+ * Start capturing public calls to a file.
+ *
+ * The file starts with the current settings, registered effects and
+ * sequences and open players, so a replay starts from the same state.
+ * Calls made from within other calls, such as sequence steps run by
+ * Haptics_update, are not captured. Best started right after init, so
+ * replayed registrations hand out the same handles.
+ *
+ * \param path File to write.
+ * \return 1 if successful.
+ */
+int Haptics_start_capture(const char *path);
+
+/**
+ * Stop capturing and close the capture file.
+ *
+ * A failed write stops the capture from recording further calls, so the file
+ * stays readable up to the failure.
+ *
+ * \return 1 if every captured call was written.
+ */
+int Haptics_stop_capture();
+
+/**
+ * Size of the data following a captured record.
+ *
+ * \param record Captured record.
+ * \return Number of bytes following the record, or -1 for a corrupt record.
+ */
+int Haptics_capture_payload_size(const HapticsCaptureRecord *record);
+
+/**
+ * Replay a captured call.
+ *
+ * Opens are replayed on the given joystick, which the backend in use must
+ * accept in place of the captured one.
+ *
+ * \param record Captured record.
+ * \param payload Data following the record.
+ * \param joystick Joystick to open players on.
+ * \return The call result to compare with the capture, the returned handle or sequence, the open result, or 0. -1 for a corrupt record, which is not replayed.
+ */
+int Haptics_replay_record(const HapticsCaptureRecord *record, const void *payload, SDL_Joystick *joystick);
+
 /**
  * Open haptics device for player when a device is added.
  *
+ * In async mode with background hotplug, the device is opened by the
+ * worker thread and the player is enabled by a later Haptics_update.
+ *
  * \param device_index SDL Joystick device index.
  * \param player Player index.
  */
@@ -1,6 +1,10 @@
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <SDL2/SDL_haptic.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_timer.h>
 #include "../../Unity/src/unity.h"
 #include "../src/haptics.h"
 
@@ -11,9 +15,10 @@ struct _SDL_Joystick {
 };
 
 int _SDL_InitSubSystem_called = 0;
+int _SDL_InitSubSystem_value = 0;
 int SDL_InitSubSystem(Uint32 flags){
 	_SDL_InitSubSystem_called = 1;
-	return 0;
+	return _SDL_InitSubSystem_value;
 }
 
 int _SDL_HapticPause_called = 0;
@@ -41,14 +46,44 @@ void SDL_HapticClose(SDL_Haptic * haptic){
 
 SDL_Haptic haptic1 = {};
 int _SDL_HapticOpenFromJoystick_called = 0;
+SDL_Haptic *_SDL_HapticOpenFromJoystick_value = &haptic1;
 SDL_Haptic *SDL_HapticOpenFromJoystick(SDL_Joystick *joystick){
 	_SDL_HapticOpenFromJoystick_called = 1;
-	return &haptic1;
+	return _SDL_HapticOpenFromJoystick_value;
+}
+
+int _SDL_HapticNumEffects_value = 32;
+int SDL_HapticNumEffects(SDL_Haptic * haptic){
+	return _SDL_HapticNumEffects_value;
+}
+
+int _SDL_HapticNumEffectsPlaying_value = 0;
+int SDL_HapticNumEffectsPlaying(SDL_Haptic * haptic){
+	return _SDL_HapticNumEffectsPlaying_value;
+}
+
+unsigned int _SDL_HapticQuery_value = 0;
+unsigned int SDL_HapticQuery(SDL_Haptic * haptic){
+	return _SDL_HapticQuery_value;
+}
+
+int _SDL_HapticSetGain_value = -1;
+int SDL_HapticSetGain(SDL_Haptic * haptic, int gain){
+	_SDL_HapticSetGain_value = gain;
+	return 0;
 }
 
 int _SDL_HapticNewEffect_called = 0;
+int _SDL_HapticNewEffect_count = 0;
 int SDL_HapticNewEffect(SDL_Haptic * haptic, SDL_HapticEffect * effect){
 	_SDL_HapticNewEffect_called = 1;
+	_SDL_HapticNewEffect_count++;
+	return 0;
+}
+
+int _SDL_HapticUpdateEffect_called = 0;
+int SDL_HapticUpdateEffect(SDL_Haptic * haptic, int effect, SDL_HapticEffect * data){
+	_SDL_HapticUpdateEffect_called = 1;
 	return 0;
 }
 
@@ -58,8 +93,10 @@ void SDL_HapticDestroyEffect(SDL_Haptic * haptic, int effect){
 }
 
 int _SDL_HapticRunEffect_called = 0;
+int _SDL_HapticRunEffect_count = 0;
 int SDL_HapticRunEffect(SDL_Haptic * haptic, int effect, Uint32 iterations){
 	_SDL_HapticRunEffect_called = 1;
+	_SDL_HapticRunEffect_count++;
 	return 0;
 }
 
@@ -78,6 +115,78 @@ SDL_Joystick *SDL_JoystickFromInstanceID(SDL_JoystickID joyid){
 	return &joystick1;
 }
 
+struct SDL_Thread {
+};
+
+struct SDL_semaphore {
+};
+
+SDL_Thread thread1 = {};
+int _SDL_CreateThread_called = 0;
+SDL_Thread *SDL_CreateThread(SDL_ThreadFunction fn, const char *name, void *data){
+	_SDL_CreateThread_called = 1;
+	return &thread1;
+}
+
+int _SDL_WaitThread_called = 0;
+void SDL_WaitThread(SDL_Thread *thread, int *status){
+	_SDL_WaitThread_called = 1;
+}
+
+SDL_sem sem1 = {};
+SDL_sem *SDL_CreateSemaphore(Uint32 initial_value){
+	return &sem1;
+}
+
+void SDL_DestroySemaphore(SDL_sem *sem){
+}
+
+int _SDL_SemWait_called = 0;
+int SDL_SemWait(SDL_sem *sem){
+	_SDL_SemWait_called = 1;
+	return 0;
+}
+
+int SDL_SemPost(SDL_sem *sem){
+	return 0;
+}
+
+int _SDL_JoystickRumble_value = -1;
+int _SDL_JoystickRumble_count = 0;
+Uint16 _SDL_JoystickRumble_low = 0;
+Uint16 _SDL_JoystickRumble_high = 0;
+int SDL_JoystickRumble(SDL_Joystick *joystick, Uint16 low_frequency_rumble, Uint16 high_frequency_rumble, Uint32 duration_ms){
+	_SDL_JoystickRumble_count++;
+	_SDL_JoystickRumble_low = low_frequency_rumble;
+	_SDL_JoystickRumble_high = high_frequency_rumble;
+	return _SDL_JoystickRumble_value;
+}
+
+Uint32 _SDL_GetTicks_value = 0;
+Uint32 SDL_GetTicks(void){
+	return _SDL_GetTicks_value;
+}
+
+Uint64 _SDL_GetPerformanceCounter_value = 0;
+Uint64 _SDL_GetPerformanceCounter_step = 0;
+Uint64 SDL_GetPerformanceCounter(void){
+	Uint64 value = _SDL_GetPerformanceCounter_value;
+	_SDL_GetPerformanceCounter_value += _SDL_GetPerformanceCounter_step;
+	return value;
+}
+
+Uint64 SDL_GetPerformanceFrequency(void){
+	return 1000000;
+}
+
+void SDL_Delay(Uint32 ms){
+}
+
+SDL_threadID _SDL_ThreadID_value = 1;
+SDL_threadID SDL_ThreadID(void){
+	return _SDL_ThreadID_value;
+}
+
 
 // runs before each test
 void setUp(void){
@@ -88,9 +197,17 @@ void setUp(void){
 	_SDL_HapticClose_called = 0;
 	_SDL_HapticOpenFromJoystick_called = 0;
 	_SDL_HapticNewEffect_called = 0;
+	_SDL_HapticNewEffect_count = 0;
+	_SDL_HapticUpdateEffect_called = 0;
+	_SDL_HapticSetGain_value = -1;
 	_SDL_HapticDestroyEffect_called = 0;
 	_SDL_HapticRunEffect_called = 0;
+	_SDL_HapticRunEffect_count = 0;
 	_SDL_HapticStopEffect_called = 0;
+	_SDL_CreateThread_called = 0;
+	_SDL_WaitThread_called = 0;
+	_SDL_SemWait_called = 0;
+	_SDL_JoystickRumble_count = 0;
 }
 
 //runs after each test
@@ -102,6 +219,20 @@ void test_Haptics_init(){
 	TEST_ASSERT_EQUAL_INT(1, _SDL_InitSubSystem_called);
 }
 
+void test_Haptics_init_with_config(){
+	HapticsConfig config = { .max_players = 2, .max_effects = 8 };
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(&config));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_InitSubSystem_called);
+
+	// table size cannot change while batched
+	Haptics_set_batched(1);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_init_with_config(NULL));
+	Haptics_set_batched(0);
+
+	// defaults
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(NULL));
+}
+
 void test_Haptics_pause_all(){
 	Haptics_pause_all();
 	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticPause_called);
@@ -152,6 +283,50 @@ void test_Haptics_player_set_gain(){
 	Haptics_player_set_gain(0, 1);
 }
 
+void test_Haptics_set_lazy_upload(){
+	SDL_Joystick joystick = {};
+	Haptics_set_lazy_upload(1);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 0));
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticNewEffect_called, "Effects should not be uploaded on connect.");
+	Haptics_set_lazy_upload(0);
+}
+
+void test_Haptics_set_async(){
+	HapticsAsyncStats stats;
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_CreateThread_called);
+	Haptics_player_stop_all(0);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticStopAll_called, "Device calls should be queued.");
+	Haptics_get_async_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(0, stats.overflows);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(0));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_WaitThread_called);
+}
+
+void test_Haptics_sync(){
+	Haptics_sync();
+	TEST_ASSERT_EQUAL_INT(0, _SDL_SemWait_called);
+}
+
+void test_Haptics_set_batched(){
+	HapticsBatchStats stats;
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_batched(1));
+	Haptics_get_batch_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(0, stats.queued);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_batched(0));
+}
+
+void test_Haptics_flush(){
+	HapticsBatchStats stats;
+
+	Haptics_flush();
+	Haptics_get_batch_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(0, stats.flushed);
+}
+
 // typedef int (config_get_int_t)(const char *key, int *value);
 int _config_get_int_called = 0;
 int config_get_int(const char *key, int *value){
@@ -173,9 +348,15 @@ int config_set_int(const char *key, int value){
 	return 1;
 }
 void test_Haptics_settings_save(){
+	// only settings changed since the load are saved
+	Haptics_player_set_gain(0, 5);
 	_config_set_int_called = 0;
 	Haptics_settings_save(config_set_int);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _config_set_int_called, "config_set_int should have been called.");
+	_config_set_int_called = 0;
+	Haptics_settings_save(config_set_int);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _config_set_int_called, "Unchanged settings should not be saved again.");
+	Haptics_player_set_gain(0, 1);
 }
 
 void test_Haptics_open_joystick_for_player(){
@@ -213,6 +394,25 @@ void test_Haptics_remove_effect(){
 	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticDestroyEffect_called, "Effect should be removed from device.");
 }
 
+void test_Haptics_remove_effect_stale_handle(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+
+	int handle1 = Haptics_register_effect(&effect1);
+	Haptics_remove_effect(handle1);
+	int handle2 = Haptics_register_effect(&effect1);
+	TEST_ASSERT_NOT_EQUAL_INT(-1, handle2);
+	TEST_ASSERT_NOT_EQUAL_INT(handle1, handle2);
+
+	_SDL_HapticDestroyEffect_called = 0;
+	Haptics_remove_effect(handle1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticDestroyEffect_called, "Stale handle should be ignored.");
+	Haptics_remove_effect(handle2);
+
+	// leave the slot with a plain index handle
+	Haptics_register_effect_at(&effect1, handle2 & 0xFFFF);
+	Haptics_remove_effect(handle2 & 0xFFFF);
+}
+
 void test_Haptics_set_effect(){
 	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
 
@@ -240,6 +440,11 @@ void test_Haptics_player_run_effect(){
 }
 
 void test_Haptics_player_update_effect(){
+	SDL_HapticEffect effect2 = { .type = SDL_HAPTIC_TRIANGLE };
+
+	Haptics_player_update_effect(0, 0, &effect2);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Effect should be updated in place.");
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticNewEffect_called);
 }
 
 void test_Haptics_player_stop_effect(){
@@ -251,10 +456,437 @@ void test_Haptics_player_stop_effect(){
 	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
 }
 
+void test_Haptics_set_effect_priority(){
+	SDL_Joystick joystick = {};
+	_SDL_HapticNumEffectsPlaying_value = 1;
+	Haptics_open_joystick_for_player(&joystick, 1);
+	Haptics_set_enabled(1);
+	Haptics_player_set_enabled(1, 1);
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	effect1.periodic.length = 100;
+	int low = Haptics_register_effect(&effect1);
+	int high = Haptics_register_effect(&effect1);
+	Haptics_set_effect_priority(high, 1);
+
+	HapticsVoiceStats before;
+	Haptics_get_voice_stats(&before);
+	_SDL_GetTicks_value = 1000;
+	_SDL_HapticRunEffect_count = 0;
+
+	// higher priority effect takes the only voice
+	Haptics_player_run_effect(1, low, 1);
+	Haptics_player_run_effect(1, high, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+
+	// lower priority effect waits for the voice to be free
+	Haptics_player_run_effect(1, low, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	_SDL_GetTicks_value = 1100;
+	Haptics_player_run_effect(1, low, 1);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_HapticRunEffect_count);
+
+	HapticsVoiceStats stats;
+	Haptics_get_voice_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(1, stats.steals - before.steals);
+	TEST_ASSERT_EQUAL_UINT(1, stats.rejections - before.rejections);
+
+	Haptics_remove_effect(low);
+	Haptics_remove_effect(high);
+	Haptics_close_for_player(1);
+	_SDL_HapticNumEffectsPlaying_value = 0;
+	_SDL_GetTicks_value = 0;
+}
+
+void test_Haptics_set_effect_retrigger(){
+	SDL_Joystick joystick = {};
+	Haptics_open_joystick_for_player(&joystick, 1);
+	Haptics_set_enabled(1);
+	Haptics_player_set_enabled(1, 1);
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	effect1.periodic.length = 100;
+	int shot = Haptics_register_effect(&effect1);
+	Haptics_set_effect_retrigger(shot, HAPTICS_RETRIGGER_INTERVAL, 50);
+
+	HapticsVoiceStats before;
+	Haptics_get_voice_stats(&before);
+	_SDL_GetTicks_value = 1000;
+	_SDL_HapticRunEffect_count = 0;
+
+	// triggers at fire rate only reach the device once per interval
+	for(int i = 0; i < 5; i++){
+		Haptics_player_run_effect(1, shot, 1);
+		_SDL_GetTicks_value += 20;
+	}
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+
+	HapticsVoiceStats stats;
+	Haptics_get_voice_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(3, stats.suppressed - before.suppressed);
+
+	Haptics_remove_effect(shot);
+	Haptics_close_for_player(1);
+	_SDL_GetTicks_value = 0;
+}
+
+void test_Haptics_player_run_sequence(){
+	SDL_Joystick joystick = {};
+	Haptics_open_joystick_for_player(&joystick, 1);
+	Haptics_set_enabled(1);
+	Haptics_player_set_enabled(1, 1);
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	int first = Haptics_register_effect(&effect1);
+	int second = Haptics_register_effect(&effect1);
+	HapticsStep steps[] = {
+		{ .effect = first },
+		{ .effect = second, .delay = 100, .gain = 5 },
+	};
+	int sequence = Haptics_register_sequence(steps, 2);
+	TEST_ASSERT_NOT_EQUAL_INT(-1, sequence);
+
+	Haptics_update(1000);
+	_SDL_HapticRunEffect_count = 0;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_player_run_sequence(1, sequence, 1));
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticRunEffect_count, "First step should run right away.");
+	Haptics_update(1050);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+	Haptics_update(1100);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Step gain should be applied to the effect.");
+
+	// finished sequences do nothing more
+	Haptics_update(1300);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+
+	// stopped sequences do nothing more
+	Haptics_player_run_sequence(1, sequence, SDL_HAPTIC_INFINITY);
+	Haptics_player_stop_sequence(1, sequence);
+	Haptics_update(1400);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_HapticRunEffect_count);
+
+	Haptics_remove_effect(first);
+	Haptics_remove_effect(second);
+	Haptics_close_for_player(1);
+	Haptics_update(0);
+}
+
+void test_Haptics_set_mixing(){
+	SDL_Joystick joystick = {};
+	Haptics_set_mixing(1);
+	_SDL_HapticQuery_value = SDL_HAPTIC_LEFTRIGHT;
+	_SDL_HapticNewEffect_count = 0;
+	Haptics_open_joystick_for_player(&joystick, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticNewEffect_count, "Only the mixer effect should be uploaded.");
+	Haptics_set_enabled(1);
+	Haptics_player_set_enabled(1, 1);
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect1.leftright.length = 100;
+	effect1.leftright.large_magnitude = 30000;
+	int effect = Haptics_register_effect(&effect1);
+
+	_SDL_GetTicks_value = 1000;
+	Haptics_update(1000);
+	Haptics_player_run_effect(1, effect, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticRunEffect_called, "Mixed effects should play on update.");
+	_SDL_GetTicks_value = 1010;
+	Haptics_update(1010);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+
+	// finished effects silence the mixer
+	_SDL_GetTicks_value = 1100;
+	Haptics_update(1100);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+
+	Haptics_remove_effect(effect);
+	Haptics_close_for_player(1);
+	Haptics_set_mixing(0);
+	_SDL_HapticQuery_value = 0;
+	_SDL_GetTicks_value = 0;
+	Haptics_update(0);
+}
+
+
+void test_Haptics_open_joystick_for_player_rumble(){
+	SDL_Joystick joystick = {};
+	_SDL_HapticOpenFromJoystick_value = NULL;
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, Haptics_open_joystick_for_player(&joystick, 1), "Joysticks without haptics or rumble should not open.");
+
+	_SDL_JoystickRumble_value = 0;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	Haptics_set_enabled(1);
+	Haptics_player_set_enabled(1, 1);
+	Haptics_player_set_gain(1, 9);
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect1.leftright.length = 100;
+	effect1.leftright.large_magnitude = 65535;
+	int effect = Haptics_register_effect(&effect1);
+
+	// rumble starts right away
+	Haptics_update(1000);
+	_SDL_JoystickRumble_count = 0;
+	Haptics_player_run_effect(1, effect, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_JoystickRumble_count);
+	TEST_ASSERT_EQUAL_INT(65535, _SDL_JoystickRumble_low);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_JoystickRumble_high);
+
+	Haptics_player_stop_effect(1, effect);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_JoystickRumble_count);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_JoystickRumble_low);
+
+	Haptics_remove_effect(effect);
+	Haptics_close_for_player(1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticClose_called, "Rumble joysticks have no haptic device to close.");
+	_SDL_HapticOpenFromJoystick_value = &haptic1;
+	_SDL_JoystickRumble_value = -1;
+	Haptics_update(0);
+}
+
+void test_Haptics_set_backend(){
+	HapticsRecord records[16];
+	HapticsRecorder recorder = { records, 16, 0, 0, NULL };
+	HapticsBackend backend;
+	SDL_Joystick joystick = {};
+	Haptics_recording_backend(&recorder, &backend);
+	Haptics_set_backend(&backend);
+	Haptics_set_lazy_upload(1);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticOpenFromJoystick_called, "Devices should be opened by the backend.");
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CALL_OPEN, records[0].call);
+	TEST_ASSERT_EQUAL_PTR(&joystick, records[0].device);
+
+	Haptics_player_stop_all(1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticStopAll_called);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CALL_STOP_ALL, records[recorder.count - 1].call);
+
+	Haptics_close_for_player(1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticClose_called);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CALL_CLOSE, records[recorder.count - 1].call);
+	TEST_ASSERT_EQUAL_INT(0, recorder.dropped);
+
+	Haptics_set_lazy_upload(0);
+	Haptics_set_backend(NULL);
+}
+
+void test_Haptics_get_stats(){
+	HapticsCounters players[4];
+	HapticsStats stats = { .players = players, .player_count = 4 };
+	SDL_Joystick joystick = {};
+	Haptics_reset_stats();
+	Haptics_set_enabled(1);
+
+	Haptics_player_set_enabled(2, 0);
+	Haptics_player_run_effect(2, 0, 1);
+	Haptics_player_set_enabled(2, 1);
+	Haptics_player_run_effect(2, 0, 1);
+
+	// a microsecond counter advancing 3 per call puts the open in the 2 to 4 microsecond bucket
+	_SDL_GetPerformanceCounter_step = 3;
+	Haptics_set_lazy_upload(1);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 2));
+	_SDL_GetPerformanceCounter_step = 0;
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_get_stats(&stats));
+	TEST_ASSERT_EQUAL_INT(2, stats.total.triggers);
+	TEST_ASSERT_EQUAL_INT(2, players[2].triggers);
+	TEST_ASSERT_EQUAL_INT(1, players[2].drops[HAPTICS_DROP_DISABLED]);
+	TEST_ASSERT_EQUAL_INT(1, players[2].drops[HAPTICS_DROP_DISCONNECTED]);
+	TEST_ASSERT_EQUAL_INT(0, players[1].triggers);
+	TEST_ASSERT_EQUAL_INT(1, stats.latency[HAPTICS_CALL_OPEN][2]);
+
+	Haptics_reset_stats();
+	TEST_ASSERT_EQUAL_INT(1, Haptics_get_stats(&stats));
+	TEST_ASSERT_EQUAL_INT(0, stats.total.triggers);
+	TEST_ASSERT_EQUAL_INT(0, stats.latency[HAPTICS_CALL_OPEN][2]);
+
+	Haptics_close_for_player(2);
+	Haptics_player_set_enabled(2, 0);
+	Haptics_set_lazy_upload(0);
+}
+
+void test_Haptics_set_tracing(){
+	char json[4096];
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_save_trace("test_trace.json"));
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_tracing(8));
+	// a player without a device makes no backend calls
+	Haptics_player_run_effect(3, 0, 1);
+	Haptics_player_stop_effect(3, 0);
+	TEST_ASSERT_EQUAL_INT(2, Haptics_save_trace("test_trace.json"));
+
+	FILE *file = fopen("test_trace.json", "r");
+	TEST_ASSERT_NOT_NULL(file);
+	size_t length = fread(json, 1, sizeof(json) - 1, file);
+	json[length] = 0;
+	fclose(file);
+	remove("test_trace.json");
+	TEST_ASSERT_EQUAL_INT(0, strncmp(json, "{\"traceEvents\":[", 16));
+	TEST_ASSERT_NOT_NULL(strstr(json, "\"name\":\"run_effect\",\"cat\":\"haptics\",\"ph\":\"X\""));
+	TEST_ASSERT_NOT_NULL(strstr(json, "\"name\":\"stop_effect\""));
+	TEST_ASSERT_NOT_NULL(strstr(json, "\"name\":\"player 3\""));
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_tracing(0));
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_save_trace("test_trace.json"));
+}
+
+void test_Haptics_start_capture(){
+	char data[8192];
+	TEST_ASSERT_EQUAL_INT(0, Haptics_start_capture("no_such_directory/test_capture.bin"));
+	TEST_ASSERT_EQUAL_INT(1, Haptics_start_capture("test_capture.bin"));
+	Haptics_player_run_effect(3, 0, 2);
+	// calls made by captured calls are not captured
+	Haptics_set_enabled(1);
+	Haptics_stop_capture();
+	Haptics_player_stop_effect(3, 0);
+
+	FILE *file = fopen("test_capture.bin", "rb");
+	TEST_ASSERT_NOT_NULL(file);
+	size_t length = fread(data, 1, sizeof(data), file);
+	fclose(file);
+	remove("test_capture.bin");
+	HapticsCaptureHeader header;
+	memcpy(&header, data, sizeof(header));
+	TEST_ASSERT_EQUAL_UINT32(HAPTICS_CAPTURE_MAGIC, header.magic);
+	TEST_ASSERT_EQUAL_UINT32(HAPTICS_CAPTURE_VERSION, header.version);
+
+	// the state snapshot comes first, the captured calls last
+	HapticsCaptureRecord records[2];
+	TEST_ASSERT_TRUE(length >= sizeof(header) + sizeof(records));
+	memcpy(records, data + length - sizeof(records), sizeof(records));
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CAPTURE_PLAYER_RUN_EFFECT, records[0].op);
+	TEST_ASSERT_EQUAL_INT(3, records[0].player);
+	TEST_ASSERT_EQUAL_INT(0, records[0].effect);
+	TEST_ASSERT_EQUAL_INT(2, records[0].value);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CAPTURE_SET_ENABLED, records[1].op);
+	TEST_ASSERT_EQUAL_INT(1, records[1].value);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_capture_payload_size(&records[0]));
+}
+
+void test_Haptics_load_bank(){
+	SDL_HapticEffect effects[2] = { { .type = SDL_HAPTIC_LEFTRIGHT }, { .type = SDL_HAPTIC_SINE } };
+	effects[0].leftright.length = 100;
+	effects[0].leftright.large_magnitude = 30000;
+	effects[1].periodic.period = 25;
+	effects[1].periodic.magnitude = 15000;
+	struct {
+		HapticsBankHeader header;
+		HapticsBankEntry entries[2];
+	} bank;
+	int size = Haptics_bank_encode(&effects[0], 20, 0, &bank.entries[0]);
+	TEST_ASSERT_EQUAL_INT(20, size);
+	size += Haptics_bank_encode(&effects[1], 21, 3, (HapticsBankEntry *)((char *)bank.entries + size));
+	HapticsBankHeader header = { HAPTICS_BANK_MAGIC, HAPTICS_BANK_VERSION, 2, size };
+	bank.header = header;
+
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_load_bank("test_missing.bank"));
+	FILE *file = fopen("test_effects.bank", "wb");
+	TEST_ASSERT_NOT_NULL(file);
+	fwrite(&bank, sizeof(HapticsBankHeader) + size, 1, file);
+	fclose(file);
+	TEST_ASSERT_EQUAL_INT(2, Haptics_load_bank("test_effects.bank"));
+	remove("test_effects.bank");
+
+	// custom effects point to their samples and cannot be banked
+	SDL_HapticEffect custom = { .type = SDL_HAPTIC_CUSTOM };
+	TEST_ASSERT_EQUAL_INT(0, Haptics_bank_encode(&custom, 22, 0, &bank.entries[0]));
+	bank.header.magic = 0;
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_register_bank(&bank, sizeof(HapticsBankHeader) + size));
+
+	Haptics_remove_effect(20);
+	Haptics_remove_effect(21);
+	Haptics_update(0);
+}
+
+void test_Haptics_watch_bank(){
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_watch_bank("test_missing.bank"));
+	Haptics_unwatch_bank();
+}
+
+void test_Haptics_set_background_hotplug(){
+	SDL_Joystick joystick = {};
+	Haptics_set_background_hotplug(1);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_player_effect_ready(3, 0));
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 3));
+	Haptics_update(0);
+	Haptics_close_for_player(3);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_player_effect_ready(3, 0));
+	Haptics_set_background_hotplug(0);
+	Haptics_update(0);
+}
+
+void test_Haptics_set_threaded(){
+	HapticsThreadStats stats;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_threaded(1));
+	Haptics_player_run_effect(0, 0, 1);
+	Haptics_update(0);
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(0, stats.drained);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_threaded(0));
+	Haptics_update(0);
+}
+
+void test_Haptics_create_context(){
+	HapticsContext *initial = Haptics_get_context();
+	HapticsContext *context = Haptics_create_context();
+	TEST_ASSERT_NOT_NULL(context);
+	Haptics_set_context(context);
+	TEST_ASSERT_EQUAL_PTR(context, Haptics_get_context());
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init());
+	Haptics_update(0);
+	Haptics_destroy_context(context);
+	TEST_ASSERT_EQUAL_PTR(initial, Haptics_get_context());
+	Haptics_update(0);
+}
+
+void test_Haptics_init_failed(){
+	SDL_HapticEffect effect = { .type = SDL_HAPTIC_CONSTANT };
+	HapticsContext *context = Haptics_create_context();
+	Haptics_set_context(context);
+
+	// calls before init do nothing
+	Haptics_player_set_enabled(0, 1);
+	Haptics_player_run_effect(0, 0, 1);
+	Haptics_run_effect_mask(0xf, 0, 1);
+	Haptics_stop_effect_mask(0xf, 0);
+	Haptics_player_stop_all(0);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_close_for_player(0));
+
+	// calls after a failed init find no devices
+	_SDL_InitSubSystem_value = -1;
+	TEST_ASSERT_EQUAL_INT(0, Haptics_init());
+	_SDL_InitSubSystem_value = 0;
+	Haptics_player_set_enabled(0, 1);
+	int handle = Haptics_register_effect(&effect);
+	Haptics_player_run_effect(0, handle, 1);
+	Haptics_run_effect_mask(0xf, handle, 1);
+	Haptics_pause_mask(0xf);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+
+	Haptics_destroy_context(context);
+}
+
+void test_Haptics_run_effect_mask(){
+	SDL_HapticEffect effect = { .type = SDL_HAPTIC_CONSTANT };
+	_SDL_HapticRunEffect_called = 0;
+	Haptics_run_effect_mask(0, 0, 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+	Haptics_stop_effect_mask(0xf, 0);
+	Haptics_pause_mask(0xf);
+	Haptics_unpause_mask(0xf);
+	Haptics_update_effect_mask(0xf, 0, &effect);
+	Haptics_update(0);
+}
 
 int main(){
 	UNITY_BEGIN();
 	RUN_TEST(test_Haptics_init);
+	RUN_TEST(test_Haptics_init_with_config);
 	RUN_TEST(test_Haptics_pause_all);
 	RUN_TEST(test_Haptics_unpause_all);
 	RUN_TEST(test_Haptics_player_pause_all);
@@ -265,16 +897,38 @@ int main(){
 	RUN_TEST(test_Haptics_set_enabled);
 	RUN_TEST(test_Haptics_player_set_enabled);
 	RUN_TEST(test_Haptics_player_set_gain);
+	RUN_TEST(test_Haptics_set_lazy_upload);
+	RUN_TEST(test_Haptics_set_async);
+	RUN_TEST(test_Haptics_sync);
+	RUN_TEST(test_Haptics_set_batched);
+	RUN_TEST(test_Haptics_flush);
 	RUN_TEST(test_Haptics_settings_load);
 	RUN_TEST(test_Haptics_settings_save);
 	RUN_TEST(test_Haptics_open_joystick_for_player);
 	RUN_TEST(test_Haptics_register_effect);
 	RUN_TEST(test_Haptics_register_effect_at);
 	RUN_TEST(test_Haptics_remove_effect);
+	RUN_TEST(test_Haptics_remove_effect_stale_handle);
 	RUN_TEST(test_Haptics_set_effect);
 	RUN_TEST(test_Haptics_player_run_effect);
 	RUN_TEST(test_Haptics_player_update_effect);
 	RUN_TEST(test_Haptics_player_stop_effect);
+	RUN_TEST(test_Haptics_set_effect_priority);
+	RUN_TEST(test_Haptics_set_effect_retrigger);
+	RUN_TEST(test_Haptics_player_run_sequence);
+	RUN_TEST(test_Haptics_set_mixing);
+	RUN_TEST(test_Haptics_open_joystick_for_player_rumble);
+	RUN_TEST(test_Haptics_set_backend);
+	RUN_TEST(test_Haptics_get_stats);
+	RUN_TEST(test_Haptics_set_tracing);
+	RUN_TEST(test_Haptics_start_capture);
+	RUN_TEST(test_Haptics_load_bank);
+	RUN_TEST(test_Haptics_watch_bank);
+	RUN_TEST(test_Haptics_set_background_hotplug);
+	RUN_TEST(test_Haptics_set_threaded);
+	RUN_TEST(test_Haptics_create_context);
+	RUN_TEST(test_Haptics_run_effect_mask);
+	RUN_TEST(test_Haptics_init_failed);
 
 	return UNITY_END();
 }
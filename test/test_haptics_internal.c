@@ -41,14 +41,44 @@ void SDL_HapticClose(SDL_Haptic * haptic){
 
 SDL_Haptic haptic1 = {};
 int _SDL_HapticOpenFromJoystick_called = 0;
+SDL_Haptic *_SDL_HapticOpenFromJoystick_value = &haptic1;
 SDL_Haptic *SDL_HapticOpenFromJoystick(SDL_Joystick *joystick){
 	_SDL_HapticOpenFromJoystick_called = 1;
-	return &haptic1;
+	return _SDL_HapticOpenFromJoystick_value;
+}
+
+int _SDL_HapticNumEffects_value = 32;
+int SDL_HapticNumEffects(SDL_Haptic * haptic){
+	return _SDL_HapticNumEffects_value;
+}
+
+int _SDL_HapticNumEffectsPlaying_value = 0;
+int SDL_HapticNumEffectsPlaying(SDL_Haptic * haptic){
+	return _SDL_HapticNumEffectsPlaying_value;
+}
+
+unsigned int _SDL_HapticQuery_value = 0;
+unsigned int SDL_HapticQuery(SDL_Haptic * haptic){
+	return _SDL_HapticQuery_value;
+}
+
+int _SDL_HapticSetGain_value = -1;
+int SDL_HapticSetGain(SDL_Haptic * haptic, int gain){
+	_SDL_HapticSetGain_value = gain;
+	return 0;
 }
 
 int _SDL_HapticNewEffect_called = 0;
+int _SDL_HapticNewEffect_count = 0;
 int SDL_HapticNewEffect(SDL_Haptic * haptic, SDL_HapticEffect * effect){
 	_SDL_HapticNewEffect_called = 1;
+	_SDL_HapticNewEffect_count++;
+	return 0;
+}
+
+int _SDL_HapticUpdateEffect_called = 0;
+int SDL_HapticUpdateEffect(SDL_Haptic * haptic, int effect, SDL_HapticEffect * data){
+	_SDL_HapticUpdateEffect_called = 1;
 	return 0;
 }
 
@@ -58,9 +88,12 @@ void SDL_HapticDestroyEffect(SDL_Haptic * haptic, int effect){
 }
 
 int _SDL_HapticRunEffect_called = 0;
+int _SDL_HapticRunEffect_count = 0;
+int _SDL_HapticRunEffect_value = 0;
 int SDL_HapticRunEffect(SDL_Haptic * haptic, int effect, Uint32 iterations){
 	_SDL_HapticRunEffect_called = 1;
-	return 0;
+	_SDL_HapticRunEffect_count++;
+	return _SDL_HapticRunEffect_value;
 }
 
 int _SDL_HapticStopEffect_called = 0;
@@ -78,6 +111,82 @@ SDL_Joystick *SDL_JoystickFromInstanceID(SDL_JoystickID joyid){
 	return &joystick1;
 }
 
+struct SDL_Thread {
+};
+
+struct SDL_semaphore {
+};
+
+SDL_Thread thread1 = {};
+int _SDL_CreateThread_called = 0;
+SDL_Thread *SDL_CreateThread(SDL_ThreadFunction fn, const char *name, void *data){
+	_SDL_CreateThread_called = 1;
+	return &thread1;
+}
+
+int _SDL_WaitThread_called = 0;
+void SDL_WaitThread(SDL_Thread *thread, int *status){
+	_SDL_WaitThread_called = 1;
+}
+
+SDL_sem sem1 = {};
+SDL_sem *SDL_CreateSemaphore(Uint32 initial_value){
+	return &sem1;
+}
+
+void SDL_DestroySemaphore(SDL_sem *sem){
+}
+
+int _SDL_SemWait_called = 0;
+int SDL_SemWait(SDL_sem *sem){
+	_SDL_SemWait_called = 1;
+	return 0;
+}
+
+int _SDL_SemPost_count = 0;
+int SDL_SemPost(SDL_sem *sem){
+	_SDL_SemPost_count++;
+	return 0;
+}
+
+int _SDL_JoystickRumble_value = -1;
+int _SDL_JoystickRumble_count = 0;
+Uint16 _SDL_JoystickRumble_low = 0;
+Uint16 _SDL_JoystickRumble_high = 0;
+Uint32 _SDL_JoystickRumble_duration = 0;
+int SDL_JoystickRumble(SDL_Joystick *joystick, Uint16 low_frequency_rumble, Uint16 high_frequency_rumble, Uint32 duration_ms){
+	_SDL_JoystickRumble_count++;
+	_SDL_JoystickRumble_duration = duration_ms;
+	_SDL_JoystickRumble_low = low_frequency_rumble;
+	_SDL_JoystickRumble_high = high_frequency_rumble;
+	return _SDL_JoystickRumble_value;
+}
+
+Uint32 _SDL_GetTicks_value = 0;
+Uint32 SDL_GetTicks(void){
+	return _SDL_GetTicks_value;
+}
+
+Uint64 _SDL_GetPerformanceCounter_value = 0;
+Uint64 _SDL_GetPerformanceCounter_step = 0;
+Uint64 SDL_GetPerformanceCounter(void){
+	Uint64 value = _SDL_GetPerformanceCounter_value;
+	_SDL_GetPerformanceCounter_value += _SDL_GetPerformanceCounter_step;
+	return value;
+}
+
+Uint64 SDL_GetPerformanceFrequency(void){
+	return 1000000;
+}
+
+void SDL_Delay(Uint32 ms){
+}
+
+SDL_threadID _SDL_ThreadID_value = 1;
+SDL_threadID SDL_ThreadID(void){
+	return _SDL_ThreadID_value;
+}
+
 // runs before each test
 void setUp(void){
 	_SDL_InitSubSystem_called = 0;
@@ -87,9 +196,17 @@ void setUp(void){
 	_SDL_HapticClose_called = 0;
 	_SDL_HapticOpenFromJoystick_called = 0;
 	_SDL_HapticNewEffect_called = 0;
+	_SDL_HapticNewEffect_count = 0;
+	_SDL_HapticUpdateEffect_called = 0;
+	_SDL_HapticSetGain_value = -1;
 	_SDL_HapticDestroyEffect_called = 0;
 	_SDL_HapticRunEffect_called = 0;
+	_SDL_HapticRunEffect_count = 0;
 	_SDL_HapticStopEffect_called = 0;
+	_SDL_CreateThread_called = 0;
+	_SDL_WaitThread_called = 0;
+	_SDL_SemWait_called = 0;
+	_SDL_JoystickRumble_count = 0;
 }
 
 //runs after each test
@@ -101,6 +218,34 @@ void test_Haptics_init(){
 	TEST_ASSERT_EQUAL_INT(1, _SDL_InitSubSystem_called);
 }
 
+void test_Haptics_init_with_config(){
+	HapticsConfig config = { .max_players = 2, .max_effects = 8 };
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(&config));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_InitSubSystem_called);
+	TEST_ASSERT_EQUAL_INT(2, haptics.max_players);
+	TEST_ASSERT_EQUAL_INT(8, haptics.max_effects);
+	TEST_ASSERT_EQUAL_INT(-1, haptics.players[1].effect[7]);
+	TEST_ASSERT_EQUAL_INT(9, haptics.players[1].gain);
+	// tables are contiguous, those read by triggers first
+	TEST_ASSERT_TRUE(((char *)haptics.playable - (char *)haptics.tables) < HAPTICS_CACHE_LINE);
+	TEST_ASSERT_EQUAL_PTR((char *)haptics.playable + _Alignof(max_align_t), haptics.connected);
+	// each player starts a cache line
+	TEST_ASSERT_EQUAL_PTR((char *)haptics.playable + HAPTICS_CACHE_LINE, haptics.players);
+	TEST_ASSERT_EQUAL_INT(0, (uintptr_t)&haptics.players[1] % HAPTICS_CACHE_LINE);
+	TEST_ASSERT_TRUE((void *)haptics.effectDefinitions > (void *)(haptics.players[1].effect + 9));
+	TEST_ASSERT_TRUE((void *)haptics.effectDefinitions > (void *)(haptics.effectHandles + 8));
+
+	// table size cannot change while batched
+	Haptics_set_batched(1);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_init_with_config(NULL));
+	Haptics_set_batched(0);
+
+	// defaults
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(NULL));
+	TEST_ASSERT_EQUAL_INT(4, haptics.max_players);
+	TEST_ASSERT_EQUAL_INT(32, haptics.max_effects);
+}
+
 void test_Haptics_pause_all(){
 	Haptics_pause_all();
 	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticPause_called);
@@ -182,6 +327,261 @@ void test_Haptics_player_set_gain(){
 	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].gain);
 }
 
+void test_Haptics_player_set_gain_applied(){
+	SDL_Joystick joystick = {};
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect1.leftright.large_magnitude = 900;
+	effect1.leftright.small_magnitude = 90;
+	haptics.effectDefinitions[0] = effect1;
+
+	// devices with gain support apply it themselves
+	_SDL_HapticQuery_value = SDL_HAPTIC_GAIN;
+	Haptics_player_set_gain(0, 9);
+	Haptics_open_joystick_for_player(&joystick, 0);
+	TEST_ASSERT_EQUAL_INT(100, _SDL_HapticSetGain_value);
+	Haptics_player_set_gain(0, 3);
+	TEST_ASSERT_EQUAL_INT(33, _SDL_HapticSetGain_value);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[0].scaled);
+	Haptics_close_for_player(0);
+
+	// other devices get pre-scaled effects
+	_SDL_HapticQuery_value = 0;
+	_SDL_HapticSetGain_value = -1;
+	_SDL_HapticUpdateEffect_called = 0;
+	Haptics_open_joystick_for_player(&joystick, 0);
+	TEST_ASSERT_EQUAL_INT(-1, _SDL_HapticSetGain_value);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].scaled);
+	TEST_ASSERT_EQUAL_INT(300, haptics.players[0].scaledDefinitions[0].leftright.large_magnitude);
+	TEST_ASSERT_EQUAL_INT(30, haptics.players[0].scaledDefinitions[0].leftright.small_magnitude);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(900, haptics.effectDefinitions[0].leftright.large_magnitude, "Registered definition should not be scaled.");
+
+	// gain changes are pushed to uploaded effects
+	Haptics_player_set_gain(0, 6);
+	TEST_ASSERT_EQUAL_INT(600, haptics.players[0].scaledDefinitions[0].leftright.large_magnitude);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Scaled effect should be updated on the device.");
+
+	// full gain uses the registered definitions
+	Haptics_player_set_gain(0, 12);
+	TEST_ASSERT_EQUAL_INT(9, haptics.players[0].gain);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[0].scaled);
+
+	Haptics_close_for_player(0);
+	Haptics_player_set_gain(0, 1);
+	haptics.effectDefinitions[0].type = 0;
+}
+
+void test_Haptics_set_lazy_upload(){
+	SDL_Joystick joystick = {};
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	for(int i = 0; i < 3; i++){
+		haptics.effectDefinitions[i] = effect1;
+	}
+
+	Haptics_set_lazy_upload(1);
+	TEST_ASSERT_EQUAL_INT(1, haptics.lazy);
+
+	// connecting a device uploads nothing
+	_SDL_HapticNumEffects_value = 2;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 0));
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticNewEffect_called, "Effects should not be uploaded on connect.");
+	TEST_ASSERT_EQUAL_INT(2, haptics.players[0].slots);
+
+	// effects are uploaded on first run
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[0].enabled;
+	haptics.enabled = 1;
+	haptics.players[0].enabled = 1;
+	Haptics_players_refresh();
+	Haptics_player_run_effect(0, 0, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticNewEffect_called, "Effect should be uploaded on first run.");
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_TRUE(haptics.players[0].effect[0] >= 0);
+	Haptics_player_run_effect(0, 1, 1);
+	TEST_ASSERT_EQUAL_INT(2, haptics.players[0].resident);
+
+	// least recently used effect is evicted when the device is full
+	Haptics_player_run_effect(0, 0, 1);
+	Haptics_player_run_effect(0, 2, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticDestroyEffect_called, "Idle effect should be evicted.");
+	TEST_ASSERT_EQUAL_INT(2, haptics.players[0].resident);
+	TEST_ASSERT_TRUE(haptics.players[0].effect[0] >= 0);
+	TEST_ASSERT_EQUAL_INT(-1, haptics.players[0].effect[1]);
+	TEST_ASSERT_TRUE(haptics.players[0].effect[2] >= 0);
+
+	// playing effects are kept while an idle effect can be evicted
+	haptics.players[0].until[0] = SDL_HAPTIC_INFINITY;
+	haptics.players[0].playing = 1;
+	Haptics_player_run_effect(0, 1, 1);
+	TEST_ASSERT_TRUE_MESSAGE(haptics.players[0].effect[0] >= 0, "Playing effect should not be evicted.");
+	TEST_ASSERT_EQUAL_INT(-1, haptics.players[0].effect[2]);
+	TEST_ASSERT_TRUE(haptics.players[0].effect[1] >= 0);
+
+	Haptics_close_for_player(0);
+	Haptics_set_lazy_upload(0);
+	haptics.enabled = enabled;
+	haptics.players[0].enabled = player_enabled;
+	_SDL_HapticNumEffects_value = 32;
+	for(int i = 0; i < 3; i++){
+		haptics.effectDefinitions[i].type = 0;
+	}
+}
+
+void test_Haptics_set_async(){
+	SDL_Joystick joystick = {};
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[0] = effect1;
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[0].enabled;
+	HapticsAsyncStats stats;
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_CreateThread_called);
+	TEST_ASSERT_NOT_NULL(haptics.queue);
+
+	// device calls are queued instead of issued
+	Haptics_open_joystick_for_player(&joystick, 0);
+	haptics.enabled = 1;
+	haptics.players[0].enabled = 1;
+	Haptics_players_refresh();
+	Haptics_player_run_effect(0, 0, 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticNewEffect_called);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_TRUE_MESSAGE(haptics.players[0].effect[0] >= 0, "Queued effect should be marked as uploaded.");
+
+	// the worker issues them
+	Haptics_queue_drain(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticNewEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+	Haptics_get_async_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(0, stats.pending);
+	TEST_ASSERT_EQUAL_INT(0, stats.overflows);
+
+	// triggers are dropped when the queue is full
+	for(int i = 0; i < HAPTICS_QUEUE_SIZE + 10; i++){
+		Haptics_player_run_effect(0, 0, 1);
+	}
+	Haptics_get_async_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_QUEUE_SIZE, stats.pending);
+	TEST_ASSERT_EQUAL_INT(10, stats.overflows);
+	Haptics_queue_drain(haptics.queue);
+
+	Haptics_close_for_player(0);
+	Haptics_queue_drain(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticClose_called);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(0));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_WaitThread_called);
+	TEST_ASSERT_NULL(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(-1, haptics.players[0].effect[0]);
+
+	haptics.enabled = enabled;
+	haptics.players[0].enabled = player_enabled;
+	haptics.effectDefinitions[0].type = 0;
+}
+
+void test_Haptics_sync(){
+	// nothing to wait for without a worker
+	Haptics_sync();
+	TEST_ASSERT_EQUAL_INT(0, _SDL_SemWait_called);
+
+	Haptics_set_async(1);
+	Haptics_sync();
+	TEST_ASSERT_EQUAL_INT(1, _SDL_SemWait_called);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_COMMAND_SYNC, haptics.queue->commands[0].type);
+	Haptics_queue_drain(haptics.queue);
+	Haptics_set_async(0);
+}
+
+void test_Haptics_set_batched(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[0] = effect1;
+	haptics.effectDefinitions[1] = effect1;
+	SDL_Haptic device1 = {};
+	haptics.players[0].device = &device1;
+	haptics.players[0].effect[0] = 1;
+	haptics.players[0].effect[1] = 2;
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[0].enabled;
+	haptics.enabled = 1;
+	haptics.players[0].enabled = 1;
+	Haptics_players_refresh();
+	HapticsBatchStats stats;
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_batched(1));
+	TEST_ASSERT_NOT_NULL(haptics.batch);
+
+	// repeated triggers are merged
+	Haptics_player_run_effect(0, 0, 1);
+	Haptics_player_run_effect(0, 0, 1);
+	Haptics_player_run_effect(0, 0, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticRunEffect_called, "Triggers should wait for the flush.");
+
+	// a run followed by a stop is cancelled
+	Haptics_player_run_effect(0, 1, 1);
+	Haptics_player_stop_effect(0, 1);
+
+	Haptics_get_batch_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(5, stats.queued);
+	TEST_ASSERT_EQUAL_INT(2, stats.coalesced);
+	TEST_ASSERT_EQUAL_INT(1, stats.cancelled);
+	TEST_ASSERT_EQUAL_INT(2, haptics.batch->count);
+
+	// a run after an update of the same effect stays after it
+	SDL_HapticEffect effect2 = effect1;
+	effect2.periodic.period = 10;
+	Haptics_player_update_effect(0, 0, &effect2);
+	Haptics_player_run_effect(0, 0, 1);
+	TEST_ASSERT_EQUAL_INT(4, haptics.batch->count);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_COMMAND_RUN, haptics.batch->commands[0].type);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_COMMAND_UPDATE, haptics.batch->commands[2].type);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_COMMAND_RUN, haptics.batch->commands[3].type);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_batched(0));
+	TEST_ASSERT_NULL(haptics.batch);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(2, _SDL_HapticRunEffect_count, "Pending commands should be flushed when batching is disabled.");
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+
+	haptics.enabled = enabled;
+	haptics.players[0].enabled = player_enabled;
+	haptics.players[0].device = NULL;
+	haptics.effectDefinitions[0].type = 0;
+	haptics.effectDefinitions[1].type = 0;
+}
+
+void test_Haptics_flush(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[0] = effect1;
+	SDL_Haptic device1 = {};
+	haptics.players[0].device = &device1;
+	haptics.players[0].effect[0] = 1;
+	HapticsBatchStats stats;
+
+	Haptics_set_batched(1);
+	Haptics_player_update_effect(0, 0, &effect1);
+	Haptics_player_update_effect(0, 0, &effect1);
+	Haptics_player_stop_effect(0, 0);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticUpdateEffect_called);
+
+	Haptics_flush();
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+	Haptics_get_batch_stats(&stats);
+	TEST_ASSERT_EQUAL_INT(2, stats.flushed);
+	TEST_ASSERT_EQUAL_INT(0, haptics.batch->count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, haptics.batch->update[0], "Pending markers should be cleared by the flush.");
+
+	// device calls that are not merged flush what came before them
+	Haptics_player_stop_effect(0, 0);
+	Haptics_player_stop_all(0);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopAll_called);
+	TEST_ASSERT_EQUAL_INT(0, haptics.batch->count);
+
+	Haptics_set_batched(0);
+	haptics.players[0].device = NULL;
+	haptics.effectDefinitions[0].type = 0;
+}
+
 // typedef int (config_get_int_t)(const char *key, int *value);
 int _config_get_int_called = 0;
 int config_get_int(const char *key, int *value){
@@ -203,9 +603,65 @@ int config_set_int(const char *key, int value){
 	return 1;
 }
 void test_Haptics_settings_save(){
+	// only settings changed since the load are saved
+	Haptics_player_set_gain(0, 5);
 	_config_set_int_called = 0;
 	Haptics_settings_save(config_set_int);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _config_set_int_called, "config_set_int should have been called.");
+	_config_set_int_called = 0;
+	Haptics_settings_save(config_set_int);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _config_set_int_called, "Unchanged settings should not be saved again.");
+	Haptics_player_set_gain(0, 1);
+}
+
+// typedef void (config_get_batch_t)(HapticsSetting *settings, int count);
+int _config_get_batch_count = 0;
+void config_get_batch(HapticsSetting *settings, int count){
+	_config_get_batch_count = count;
+	// only player 1 gain has a saved value
+	for(int i = 0; i < count; i++){
+		if(!strcmp(settings[i].key, "haptics_player_1_gain")){
+			settings[i].value = 4;
+			settings[i].found = 1;
+		}
+	}
+}
+
+// typedef int (config_set_batch_t)(const HapticsSetting *settings, int count);
+HapticsSetting _config_set_batch_settings[16];
+int _config_set_batch_count = 0;
+int config_set_batch(const HapticsSetting *settings, int count){
+	_config_set_batch_count = count;
+	memcpy(_config_set_batch_settings, settings, sizeof(HapticsSetting) * count);
+	return 1;
+}
+
+void test_Haptics_settings_save_batch(){
+	int gain[2] = { haptics.players[0].gain, haptics.players[1].gain };
+	TEST_ASSERT_EQUAL_STRING("haptics_player_1_gain", haptics.settings[3].key);
+
+	// settings missing from the configuration stay unsaved
+	Haptics_settings_load_batch(config_get_batch);
+	TEST_ASSERT_EQUAL_INT(haptics.max_players * 2, _config_get_batch_count);
+	TEST_ASSERT_EQUAL_INT(4, haptics.players[1].gain);
+	Haptics_settings_save_batch(config_set_batch);
+	TEST_ASSERT_EQUAL_INT((haptics.max_players * 2) - 1, _config_set_batch_count);
+	TEST_ASSERT_EQUAL_STRING("haptics_player_0_enabled", _config_set_batch_settings[0].key);
+	TEST_ASSERT_EQUAL_STRING("haptics_player_1_enabled", _config_set_batch_settings[2].key);
+
+	// only changed settings are saved, and nothing when none changed
+	Haptics_player_set_gain(0, 7);
+	Haptics_player_set_gain(1, 4);
+	Haptics_settings_save_batch(config_set_batch);
+	TEST_ASSERT_EQUAL_INT(1, _config_set_batch_count);
+	TEST_ASSERT_EQUAL_STRING("haptics_player_0_gain", _config_set_batch_settings[0].key);
+	TEST_ASSERT_EQUAL_INT(7, _config_set_batch_settings[0].value);
+	_config_set_batch_count = 0;
+	Haptics_settings_save_batch(config_set_batch);
+	TEST_ASSERT_EQUAL_INT(0, _config_set_batch_count);
+
+	Haptics_player_set_gain(0, gain[0]);
+	Haptics_player_set_gain(1, gain[1]);
 }
 
 void test_Haptics_open_joystick_for_player(){
@@ -216,6 +672,100 @@ void test_Haptics_open_joystick_for_player(){
 	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticNewEffect_called, "Effect should be added to the device.");
 }
 
+void test_Haptics_open_joystick_for_player_rumble(){
+	SDL_Joystick joystick = {};
+	_SDL_HapticOpenFromJoystick_value = NULL;
+	_SDL_JoystickRumble_value = 0;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	TEST_ASSERT_EQUAL_PTR(&joystick, haptics.players[1].rumble);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].mixing);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticNewEffect_called);
+
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	int gain = haptics.players[1].gain;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	Haptics_players_refresh();
+	haptics.players[1].gain = 9;
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect1.leftright.length = 100;
+	effect1.leftright.small_magnitude = 65535;
+	haptics.effectDefinitions[2] = effect1;
+
+	_SDL_GetTicks_value = 1000;
+	Haptics_update(1000);
+	_SDL_JoystickRumble_count = 0;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_JoystickRumble_count, "Rumble should start right away.");
+	TEST_ASSERT_EQUAL_INT(65535, _SDL_JoystickRumble_high);
+	TEST_ASSERT_EQUAL_UINT_MESSAGE(100, _SDL_JoystickRumble_duration, "Rumble should last as long as the effect.");
+
+	// paused rumble is silenced and pushed again on unpause
+	Haptics_player_pause_all(1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_JoystickRumble_count);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_JoystickRumble_high);
+	_SDL_GetTicks_value = 1010;
+	Haptics_update(1010);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_JoystickRumble_count);
+	Haptics_player_unpause_all(1);
+	_SDL_GetTicks_value = 1020;
+	Haptics_update(1020);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_JoystickRumble_count);
+	TEST_ASSERT_EQUAL_INT(65535, _SDL_JoystickRumble_high);
+
+	// a removed effect leaves the mix right away
+	SDL_HapticEffect effect2 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect2.leftright.length = SDL_HAPTIC_INFINITY;
+	effect2.leftright.large_magnitude = 65535;
+	Haptics_register_effect_at(&effect2, 3);
+	int handle2 = haptics.effectHandles[3];
+	Haptics_player_run_effect(1, handle2, 1);
+	TEST_ASSERT_EQUAL_INT(65535, _SDL_JoystickRumble_low);
+	Haptics_remove_effect(handle2);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_JoystickRumble_low);
+	_SDL_GetTicks_value = 5000;
+	Haptics_update(5000);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_JoystickRumble_low);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].mixer.count);
+	// leave the slot with a plain index handle
+	Haptics_register_effect_at(&effect2, 3);
+	Haptics_remove_effect(3);
+
+	// effects run without updates in between are timed from when they run
+	effect2.leftright.length = 200;
+	effect2.leftright.large_magnitude = 32767;
+	haptics.effectDefinitions[3] = effect2;
+	effect2.leftright.length = 3000;
+	haptics.effectDefinitions[4] = effect2;
+	_SDL_GetTicks_value = 6000;
+	Haptics_player_run_effect(1, 3, 1);
+	_SDL_GetTicks_value = 60000;
+	Haptics_player_run_effect(1, 4, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(32767, _SDL_JoystickRumble_low, "Ended effect should not be mixed in.");
+	TEST_ASSERT_EQUAL_UINT(1000, _SDL_JoystickRumble_duration);
+	Haptics_update(60000);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].mixer.count);
+	TEST_ASSERT_EQUAL_INT(32767, _SDL_JoystickRumble_low);
+	Haptics_player_stop_effect(1, 4);
+	haptics.effectDefinitions[3].type = 0;
+	haptics.effectDefinitions[4].type = 0;
+
+	Haptics_close_for_player(1);
+	TEST_ASSERT_NULL(haptics.players[1].rumble);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].mixing);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticClose_called);
+
+	haptics.effectDefinitions[2].type = 0;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	haptics.players[1].gain = gain;
+	_SDL_HapticOpenFromJoystick_value = &haptic1;
+	_SDL_JoystickRumble_value = -1;
+	_SDL_GetTicks_value = 0;
+	Haptics_update(0);
+}
+
 void test_Haptics_register_effect(){
 	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
 	haptics.effectDefinitions[0] = effect1;
@@ -255,6 +805,45 @@ void test_Haptics_remove_effect(){
 	TEST_ASSERT_EQUAL_INT_MESSAGE(-1, haptics.players[0].effect[0], "Effect should be removed from the player.");
 }
 
+void test_Haptics_remove_effect_stale_handle(){
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[0].enabled;
+	haptics.enabled = 1;
+	haptics.players[0].enabled = 1;
+	struct _SDL_Haptic *device = haptics.players[0].device;
+	SDL_Haptic device1 = {};
+	haptics.players[0].device = &device1;
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	int handle1 = Haptics_register_effect(&effect1);
+	int index = handle1 & HAPTICS_HANDLE_INDEX_MASK;
+	Haptics_remove_effect(handle1);
+	TEST_ASSERT_EQUAL_INT(0, haptics.effectDefinitions[index].type);
+
+	int handle2 = Haptics_register_effect(&effect1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(index, handle2 & HAPTICS_HANDLE_INDEX_MASK, "Removed slot should be reused.");
+	TEST_ASSERT_NOT_EQUAL_INT(handle1, handle2);
+
+	_SDL_HapticRunEffect_count = 0;
+	Haptics_player_run_effect(0, handle1, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticRunEffect_count, "Stale handle should not run the new effect.");
+	Haptics_player_run_effect(0, handle2, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+
+	// stale handles do not remove the new effect
+	Haptics_remove_effect(handle1);
+	TEST_ASSERT_EQUAL_INT(SDL_HAPTIC_SINE, haptics.effectDefinitions[index].type);
+	Haptics_remove_effect(handle2);
+	TEST_ASSERT_EQUAL_INT(0, haptics.effectDefinitions[index].type);
+
+	// leave the slot with a plain index handle
+	Haptics_register_effect_at(&effect1, index);
+	Haptics_remove_effect(index);
+	haptics.players[0].device = device;
+	haptics.enabled = enabled;
+	haptics.players[0].enabled = player_enabled;
+}
+
 void test_Haptics_set_effect(){
 	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
 	haptics.effectDefinitions[0] = effect1;
@@ -272,6 +861,7 @@ void test_Haptics_player_run_effect(){
 	haptics.effectDefinitions[0] = effect1;
 	SDL_Haptic device1 = {};
 	haptics.players[0].device = &device1;
+	Haptics_players_refresh();
 	haptics.players[0].effect[0] = 1;
 
 	Haptics_player_run_effect(0, 0, 1);
@@ -285,11 +875,63 @@ void test_Haptics_player_run_effect(){
 
 	// player enabled flag is honored
 	haptics.players[0].enabled = 1;
+	Haptics_players_refresh();
 	Haptics_player_run_effect(0, 0, 1);
 	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
 }
 
 void test_Haptics_player_update_effect(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[0] = effect1;
+	SDL_Haptic device1 = {};
+	haptics.players[0].device = &device1;
+	haptics.players[0].effect[0] = 1;
+
+	// same type is updated in place
+	SDL_HapticEffect effect2 = { .type = SDL_HAPTIC_SINE };
+	effect2.periodic.magnitude = 1000;
+	Haptics_player_update_effect(0, 0, &effect2);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Effect should be updated in place.");
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticNewEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].effect[0]);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(SDL_HAPTIC_SINE, haptics.effectDefinitions[0].type, "Registered definition should not change.");
+
+	// type change re-creates the effect
+	SDL_HapticEffect effect3 = { .type = SDL_HAPTIC_TRIANGLE };
+	Haptics_player_update_effect(0, 0, &effect3);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticDestroyEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticNewEffect_called);
+
+	haptics.players[0].device = NULL;
+}
+
+void test_Haptics_set_effect_in_place(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[0] = effect1;
+	SDL_Haptic device1 = {};
+	haptics.players[0].device = &device1;
+	haptics.players[0].effect[0] = 1;
+	haptics.players[0].resident = 1;
+
+	// repeated edits keep the device slot
+	for(int i = 0; i < 10; i++){
+		effect1.periodic.magnitude = i * 1000;
+		Haptics_set_effect(&effect1, 0);
+	}
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticNewEffect_count, "No new device effects should be created.");
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticDestroyEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].effect[0]);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].resident);
+
+	// a type change replaces the device effect without leaking the old one
+	SDL_HapticEffect effect2 = { .type = SDL_HAPTIC_TRIANGLE };
+	Haptics_set_effect(&effect2, 0);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticDestroyEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticNewEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[0].resident);
+
+	haptics.players[0].device = NULL;
 }
 
 void test_Haptics_player_stop_effect(){
@@ -304,10 +946,1063 @@ void test_Haptics_player_stop_effect(){
 	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
 }
 
+void test_Haptics_set_effect_priority(){
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	SDL_Haptic device1 = {};
+	haptics.players[1].device = &device1;
+	Haptics_players_refresh();
+	haptics.players[1].voices = 1;
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	effect1.periodic.length = 100;
+	haptics.effectDefinitions[2] = effect1;
+	haptics.effectDefinitions[3] = effect1;
+	haptics.players[1].effect[2] = 2;
+	haptics.players[1].effect[3] = 3;
+	Haptics_set_effect_priority(3, 5);
+
+	HapticsVoiceStats before = haptics.voiceStats;
+	_SDL_GetTicks_value = 1000;
+	_SDL_HapticRunEffect_count = 0;
+
+	Haptics_player_run_effect(1, 3, 2);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].playing);
+	TEST_ASSERT_EQUAL_UINT_MESSAGE(1200, haptics.players[1].until[3], "Voice should be held for every iteration.");
+
+	// lower priority effect is rejected while the voice is busy
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_UINT(1, haptics.voiceStats.rejections - before.rejections);
+
+	// finished effects free their voice
+	_SDL_GetTicks_value = 1200;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticStopEffect_called);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.players[1].until[3]);
+
+	// higher priority effect steals the voice
+	Haptics_player_run_effect(1, 3, 1);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+	TEST_ASSERT_EQUAL_UINT(1, haptics.voiceStats.steals - before.steals);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].playing);
+
+	// stopping frees the voice
+	Haptics_player_stop_effect(1, 3);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].playing);
+
+	// a run the device refuses does not hold the voice
+	_SDL_HapticRunEffect_value = -1;
+	Haptics_player_run_effect(1, 3, SDL_HAPTIC_INFINITY);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].playing);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.players[1].until[3]);
+	_SDL_HapticRunEffect_value = 0;
+	_SDL_HapticStopEffect_called = 0;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(5, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticStopEffect_called);
+	TEST_ASSERT_EQUAL_UINT(1, haptics.voiceStats.rejections - before.rejections);
+	TEST_ASSERT_EQUAL_UINT(1, haptics.voiceStats.steals - before.steals);
+	Haptics_player_stop_effect(1, 2);
+
+	haptics.effectPriorities[3] = 0;
+	haptics.effectDefinitions[2].type = 0;
+	haptics.effectDefinitions[3].type = 0;
+	haptics.players[1].effect[2] = -1;
+	haptics.players[1].effect[3] = -1;
+	haptics.players[1].voices = 0;
+	haptics.players[1].device = NULL;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	_SDL_GetTicks_value = 0;
+}
+
+void test_Haptics_effect_length(){
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	effect1.periodic.length = 100;
+	effect1.periodic.delay = 20;
+	TEST_ASSERT_EQUAL_UINT(120, Haptics_effect_length(&effect1, 0));
+	TEST_ASSERT_EQUAL_UINT(320, Haptics_effect_length(&effect1, 3));
+	TEST_ASSERT_EQUAL_UINT(SDL_HAPTIC_INFINITY, Haptics_effect_length(&effect1, SDL_HAPTIC_INFINITY));
+	// long runs saturate rather than wrapping to a short end
+	TEST_ASSERT_EQUAL_UINT_MESSAGE(SDL_HAPTIC_INFINITY, Haptics_effect_length(&effect1, 50000000), "Length should saturate.");
+	effect1.periodic.length = SDL_HAPTIC_INFINITY;
+	TEST_ASSERT_EQUAL_UINT(SDL_HAPTIC_INFINITY, Haptics_effect_length(&effect1, 1));
+}
+
+void test_Haptics_set_effect_retrigger(){
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	SDL_Haptic device1 = {};
+	haptics.players[1].device = &device1;
+	Haptics_players_refresh();
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	effect1.periodic.length = 100;
+	haptics.effectDefinitions[2] = effect1;
+	haptics.players[1].effect[2] = 2;
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_IGNORE, 0);
+
+	HapticsVoiceStats before = haptics.voiceStats;
+	Haptics_reset_stats();
+	_SDL_GetTicks_value = 1000;
+	_SDL_HapticRunEffect_count = 0;
+
+	// playing effect ignores triggers until it ends
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_UINT(1100, haptics.players[1].retrigger[2]);
+	_SDL_GetTicks_value = 1100;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+
+	// stopping lets it start again
+	Haptics_player_stop_effect(1, 2);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_HapticRunEffect_count);
+
+	// extended effect restarts once when it ends
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_EXTEND, 0);
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(4, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, haptics.extending);
+	_SDL_GetTicks_value = 1150;
+	Haptics_update(1150);
+	TEST_ASSERT_EQUAL_INT(4, _SDL_HapticRunEffect_count);
+	_SDL_GetTicks_value = 1200;
+	Haptics_update(1200);
+	TEST_ASSERT_EQUAL_INT(5, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, haptics.extending);
+	TEST_ASSERT_EQUAL_UINT(1300, haptics.players[1].retrigger[2]);
+
+	// interval limited effect starts at most once per interval, even after a stop
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_INTERVAL, 50);
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_stop_effect(1, 2);
+	_SDL_GetTicks_value = 1230;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(6, _SDL_HapticRunEffect_count);
+	_SDL_GetTicks_value = 1250;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(7, _SDL_HapticRunEffect_count);
+
+	TEST_ASSERT_EQUAL_UINT(4, haptics.voiceStats.suppressed - before.suppressed);
+#ifndef HAPTICS_NO_STATS
+	TEST_ASSERT_EQUAL_INT(4, haptics.effectCounters[2].drops[HAPTICS_DROP_RETRIGGER]);
+#endif
+
+	// a start the device refuses does not hold off the next trigger
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_IGNORE, 0);
+	_SDL_HapticRunEffect_value = -1;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.players[1].retrigger[2]);
+	_SDL_HapticRunEffect_value = 0;
+	haptics.players[1].voices = 1;
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(9, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_UINT(1350, haptics.players[1].retrigger[2]);
+
+	// an effect whose voice is stolen may start again right away
+	haptics.effectDefinitions[3] = effect1;
+	haptics.players[1].effect[3] = 3;
+	haptics.effectPriorities[3] = 1;
+	Haptics_player_run_effect(1, 3, 1);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.players[1].retrigger[2]);
+	Haptics_player_stop_effect(1, 3);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(11, _SDL_HapticRunEffect_count);
+	Haptics_player_stop_effect(1, 2);
+	haptics.players[1].voices = 0;
+	haptics.effectPriorities[3] = 0;
+	haptics.effectDefinitions[3].type = 0;
+	haptics.players[1].effect[3] = -1;
+
+	// stopping everything forgets pending restarts
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_EXTEND, 0);
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(1, haptics.extending);
+	Haptics_player_stop_all(1);
+	TEST_ASSERT_EQUAL_INT(0, haptics.extending);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.players[1].retrigger[2]);
+
+	Haptics_set_effect_retrigger(2, HAPTICS_RETRIGGER_RESTART, 0);
+	haptics.effectDefinitions[2].type = 0;
+	haptics.players[1].effect[2] = -1;
+	haptics.players[1].device = NULL;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	_SDL_GetTicks_value = 0;
+}
+
+void test_Haptics_player_run_sequence(){
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	SDL_Haptic device1 = {};
+	haptics.players[1].device = &device1;
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_SINE };
+	haptics.effectDefinitions[2] = effect1;
+	haptics.effectDefinitions[3] = effect1;
+	haptics.players[1].effect[2] = 2;
+	haptics.players[1].effect[3] = 3;
+
+	HapticsStep steps[] = {
+		{ .effect = 2 },
+		{ .effect = 3, .delay = 100, .gain = 3 },
+	};
+	int sequence = Haptics_register_sequence(steps, 2);
+	TEST_ASSERT_EQUAL_INT(2, haptics.sequences[sequence].count);
+
+	Haptics_update(1000);
+	_SDL_HapticRunEffect_count = 0;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_player_run_sequence(1, sequence, 2));
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticRunEffect_count, "First step should run right away.");
+	TEST_ASSERT_EQUAL_INT(1, haptics.timelineCount);
+
+	Haptics_update(1099);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+
+	// second step, then the first step of the second iteration
+	Haptics_update(1100);
+	TEST_ASSERT_EQUAL_INT(3, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Step gain should be applied to the effect.");
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].altered[3]);
+
+	Haptics_update(1200);
+	TEST_ASSERT_EQUAL_INT(4, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, haptics.timelineCount, "Finished sequence should be removed.");
+
+	// a plain run restores the definition a step gain altered
+	_SDL_HapticUpdateEffect_called = 0;
+	Haptics_player_run_effect(1, 3, 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticUpdateEffect_called, "Plain run should restore the effect.");
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].altered[3]);
+	_SDL_HapticUpdateEffect_called = 0;
+	Haptics_player_run_effect(1, 3, 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticUpdateEffect_called);
+
+	// stopping all player effects stops sequences
+	Haptics_player_run_sequence(1, sequence, SDL_HAPTIC_INFINITY);
+	TEST_ASSERT_EQUAL_INT(1, haptics.timelineCount);
+	Haptics_player_stop_all(1);
+	TEST_ASSERT_EQUAL_INT(0, haptics.timelineCount);
+
+	// sequences without delays run one pass per update
+	HapticsStep instant[] = { { .effect = 2 } };
+	int loop = Haptics_register_sequence(instant, 1);
+	_SDL_HapticRunEffect_count = 0;
+	Haptics_player_run_sequence(1, loop, SDL_HAPTIC_INFINITY);
+	Haptics_update(1300);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	Haptics_player_stop_sequence(1, loop);
+	TEST_ASSERT_EQUAL_INT(0, haptics.timelineCount);
+
+	// sequences started before the first update are timed from it
+	haptics.ticking = 0;
+	haptics.now = 0;
+	_SDL_HapticRunEffect_count = 0;
+	Haptics_player_run_sequence(1, sequence, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+	Haptics_update(5000);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(1, _SDL_HapticRunEffect_count, "Delayed step should wait for its delay after the first update.");
+	Haptics_update(5100);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, haptics.timelineCount);
+
+	haptics.effectDefinitions[2].type = 0;
+	haptics.effectDefinitions[3].type = 0;
+	haptics.players[1].effect[2] = -1;
+	haptics.players[1].effect[3] = -1;
+	haptics.players[1].altered[3] = 0;
+	haptics.players[1].device = NULL;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	Haptics_update(0);
+}
+
+void test_Haptics_set_mixing(){
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	SDL_Haptic device1 = {};
+	haptics.players[1].device = &device1;
+	int gain = haptics.players[1].gain;
+	haptics.players[1].gain = 9;
+	haptics.players[1].mixing = 1;
+	haptics.players[1].effect[HAPTICS_MIXER_EFFECT] = 0;
+
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_LEFTRIGHT };
+	effect1.leftright.length = 100;
+	effect1.leftright.large_magnitude = 65535;
+	haptics.effectDefinitions[2] = effect1;
+	SDL_HapticEffect effect2 = { .type = SDL_HAPTIC_CONSTANT };
+	effect2.constant.length = 100;
+	effect2.constant.level = 32767;
+	effect2.constant.fade_length = 100;
+	haptics.effectDefinitions[3] = effect2;
+
+	_SDL_GetTicks_value = 1000;
+	Haptics_update(1000);
+	Haptics_player_run_effect(1, 2, 1);
+	Haptics_player_run_effect(1, 3, 1);
+	TEST_ASSERT_EQUAL_INT(2, haptics.players[1].mixer.count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, _SDL_HapticRunEffect_called, "Mixed effects should play on update.");
+
+	// both motors get the constant effect, halfway through its fade
+	_SDL_GetTicks_value = 1050;
+	Haptics_update(1050);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(65535, haptics.players[1].mixer.large_magnitude, "Mixed levels should be clamped.");
+	TEST_ASSERT_EQUAL_INT(32767, haptics.players[1].mixer.small_magnitude);
+
+	// unchanged mix is not pushed again
+	_SDL_HapticRunEffect_called = 0;
+	_SDL_GetTicks_value = 1050;
+	Haptics_update(1050);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+
+	// stopped effects leave the mix
+	Haptics_player_stop_effect(1, 3);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].mixer.count);
+	TEST_ASSERT_EQUAL_INT(2, haptics.players[1].mixer.effect[0]);
+
+	// finished effects silence the mixer
+	_SDL_GetTicks_value = 1100;
+	Haptics_update(1100);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].mixer.count);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+
+	haptics.effectDefinitions[2].type = 0;
+	haptics.effectDefinitions[3].type = 0;
+	haptics.players[1].effect[HAPTICS_MIXER_EFFECT] = -1;
+	haptics.players[1].mixing = 0;
+	haptics.players[1].gain = gain;
+	haptics.players[1].device = NULL;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	_SDL_GetTicks_value = 0;
+	Haptics_update(0);
+}
+
+
+void test_Haptics_set_backend(){
+	SDL_Joystick joystick = {};
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	SDL_HapticEffect effect1 = { .type = SDL_HAPTIC_CONSTANT };
+	haptics.effectDefinitions[2] = effect1;
+
+	// null devices have every feature and room for every effect
+	Haptics_set_backend(Haptics_null_backend());
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticOpenFromJoystick_called);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].hardware_gain);
+	TEST_ASSERT_EQUAL_INT(haptics.max_effects, haptics.players[1].slots);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].effect[2]);
+	Haptics_player_run_effect(1, 2, 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+	Haptics_close_for_player(1);
+
+	// recording on top of the SDL backend, with calls past the buffer counted
+	HapticsRecord records[1];
+	HapticsRecorder recorder = { records, 1, 0, 0, Haptics_sdl_backend() };
+	HapticsBackend backend;
+	Haptics_recording_backend(&recorder, &backend);
+	Haptics_set_backend(&backend);
+	Haptics_set_lazy_upload(1);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticOpenFromJoystick_called);
+	Haptics_player_run_effect(1, 2, 3);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_EQUAL_INT(1, recorder.count);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CALL_OPEN, records[0].call);
+	TEST_ASSERT_NOT_EQUAL_INT(0, recorder.dropped);
+	Haptics_close_for_player(1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticClose_called);
+
+	Haptics_set_lazy_upload(0);
+	Haptics_set_backend(NULL);
+	haptics.effectDefinitions[2].type = 0;
+	haptics.enabled = enabled;
+	haptics.players[1].enabled = player_enabled;
+	Haptics_update(0);
+}
+
+void test_Haptics_get_stats(){
+	HapticsCounters players[2];
+	HapticsCounters effects[4];
+	HapticsStats stats = { .players = players, .player_count = 2, .effects = effects, .effect_count = 4 };
+	SDL_Haptic *device = haptics.players[1].device;
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	int voices = haptics.players[1].voices;
+	int lazy = haptics.lazy;
+	SDL_HapticEffect definition = haptics.effectDefinitions[2];
+	haptics.enabled = 1;
+	haptics.lazy = 0;
+	haptics.players[1].enabled = 1;
+	haptics.players[1].device = &haptic1;
+	Haptics_players_refresh();
+	haptics.players[1].voices = 0;
+	haptics.players[1].effect[2] = -1;
+	haptics.effectDefinitions[2].type = SDL_HAPTIC_CONSTANT;
+	int handle = haptics.effectHandles[2];
+	Haptics_reset_stats();
+
+	// not on the device, refused by the device, stale handle
+	Haptics_player_run_effect(1, handle, 1);
+	haptics.players[1].effect[2] = 0;
+	_SDL_HapticRunEffect_value = -1;
+	_SDL_GetPerformanceCounter_step = 5;
+	Haptics_player_run_effect(1, handle, 1);
+	_SDL_GetPerformanceCounter_step = 0;
+	_SDL_HapticRunEffect_value = 0;
+	Haptics_player_run_effect(1, handle + (1 << HAPTICS_HANDLE_INDEX_BITS), 1);
+	Haptics_player_stop_effect(1, handle);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_get_stats(&stats));
+	TEST_ASSERT_EQUAL_INT(3, stats.total.triggers);
+	TEST_ASSERT_EQUAL_INT(3, players[1].triggers);
+	TEST_ASSERT_EQUAL_INT(0, players[0].triggers);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(2, effects[2].triggers, "Stale handles are not counted for effects.");
+	TEST_ASSERT_EQUAL_INT(1, effects[2].drops[HAPTICS_DROP_NOT_UPLOADED]);
+	TEST_ASSERT_EQUAL_INT(1, effects[2].drops[HAPTICS_DROP_DEVICE]);
+	TEST_ASSERT_EQUAL_INT(1, players[1].drops[HAPTICS_DROP_INVALID]);
+	TEST_ASSERT_EQUAL_INT(1, effects[2].stops);
+	// 5 microseconds falls in the 4 to 8 microsecond bucket
+	TEST_ASSERT_EQUAL_INT(1, stats.latency[HAPTICS_CALL_RUN_EFFECT][3]);
+	TEST_ASSERT_EQUAL_INT(1, stats.latency[HAPTICS_CALL_STOP_EFFECT][0]);
+
+	Haptics_reset_stats();
+	TEST_ASSERT_EQUAL_INT(1, Haptics_get_stats(&stats));
+	TEST_ASSERT_EQUAL_INT(0, players[1].triggers);
+	TEST_ASSERT_EQUAL_INT(0, effects[2].stops);
+
+	haptics.players[1].effect[2] = -1;
+	haptics.effectDefinitions[2] = definition;
+	haptics.players[1].device = device;
+	haptics.players[1].voices = voices;
+	haptics.players[1].enabled = player_enabled;
+	haptics.enabled = enabled;
+	haptics.lazy = lazy;
+	Haptics_update(0);
+}
+
+void test_Haptics_set_tracing(){
+	SDL_Haptic *device = haptics.players[1].device;
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	int voices = haptics.players[1].voices;
+	SDL_HapticEffect definition = haptics.effectDefinitions[2];
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	haptics.players[1].device = &haptic1;
+	haptics.players[1].voices = 0;
+	haptics.players[1].effect[2] = 0;
+	haptics.effectDefinitions[2].type = SDL_HAPTIC_CONSTANT;
+	int handle = haptics.effectHandles[2];
+
+	// the backend call nests inside the run, and is recorded first as it ends first
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_tracing(2));
+	_SDL_GetPerformanceCounter_step = 10;
+	Haptics_player_run_effect(1, handle, 1);
+	_SDL_GetPerformanceCounter_step = 0;
+	TEST_ASSERT_EQUAL_INT(2, haptics.trace->count);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_TRACE_CALLS + HAPTICS_CALL_RUN_EFFECT, haptics.trace->events[0].name);
+	TEST_ASSERT_EQUAL_INT(10, haptics.trace->events[0].duration);
+	TEST_ASSERT_EQUAL_INT(2, haptics.trace->events[0].effect);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_TRACE_RUN, haptics.trace->events[1].name);
+	TEST_ASSERT_EQUAL_INT(30, haptics.trace->events[1].duration);
+	TEST_ASSERT_EQUAL_INT(1, haptics.trace->events[1].player);
+	TEST_ASSERT_EQUAL_INT(handle, haptics.trace->events[1].effect);
+
+	// the ring keeps the most recent events
+	Haptics_player_stop_effect(1, handle);
+	TEST_ASSERT_EQUAL_INT(4, haptics.trace->count);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_TRACE_CALLS + HAPTICS_CALL_STOP_EFFECT, haptics.trace->events[0].name);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_TRACE_STOP, haptics.trace->events[1].name);
+	TEST_ASSERT_EQUAL_INT(2, Haptics_save_trace("test_trace.json"));
+	remove("test_trace.json");
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_tracing(0));
+	TEST_ASSERT_NULL(haptics.trace);
+
+	haptics.players[1].effect[2] = -1;
+	haptics.effectDefinitions[2] = definition;
+	haptics.players[1].device = device;
+	haptics.players[1].voices = voices;
+	haptics.players[1].enabled = player_enabled;
+	haptics.enabled = enabled;
+	Haptics_update(0);
+}
+
+void test_Haptics_start_capture(){
+	char data[8192];
+	SDL_Haptic *device = haptics.players[1].device;
+	int enabled = haptics.enabled;
+	int player_enabled = haptics.players[1].enabled;
+	int voices = haptics.players[1].voices;
+	SDL_HapticEffect definition = haptics.effectDefinitions[2];
+	haptics.enabled = 1;
+	haptics.players[1].enabled = 1;
+	haptics.players[1].device = &haptic1;
+	haptics.players[1].voices = 0;
+	haptics.players[1].effect[2] = 0;
+	haptics.effectDefinitions[2].type = SDL_HAPTIC_CONSTANT;
+	int handle = haptics.effectHandles[2];
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_start_capture("test_capture.bin"));
+	TEST_ASSERT_NOT_NULL(haptics.capture);
+	Haptics_player_run_effect(1, handle, 1);
+	_SDL_GetPerformanceCounter_value += 2000;
+	// the nested stop is not captured
+	Haptics_player_set_enabled(1, 1);
+	Haptics_set_lazy_upload(haptics.lazy);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_stop_capture());
+	TEST_ASSERT_NULL(haptics.capture);
+
+	FILE *file = fopen("test_capture.bin", "rb");
+	TEST_ASSERT_NOT_NULL(file);
+	size_t length = fread(data, 1, sizeof(data), file);
+	fclose(file);
+	remove("test_capture.bin");
+	HapticsCaptureRecord records[3];
+	memcpy(records, data + length - sizeof(records), sizeof(records));
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CAPTURE_PLAYER_RUN_EFFECT, records[0].op);
+	TEST_ASSERT_EQUAL_INT(1, records[0].player);
+	TEST_ASSERT_EQUAL_INT(handle, records[0].effect);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CAPTURE_PLAYER_SET_ENABLED, records[1].op);
+	// records are timed relative to the previous record
+	TEST_ASSERT_EQUAL_INT(2000, records[1].delta_us);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_CAPTURE_SET_LAZY_UPLOAD, records[2].op);
+
+	// replaying the record runs the effect again
+	_SDL_HapticRunEffect_called = 0;
+	TEST_ASSERT_EQUAL_INT(0, Haptics_replay_record(&records[0], NULL, NULL));
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_called);
+
+	// mode switches are replayed
+	int lazy = haptics.lazy;
+	records[2].value = !lazy;
+	Haptics_replay_record(&records[2], NULL, NULL);
+	TEST_ASSERT_EQUAL_INT(!lazy, haptics.lazy);
+	Haptics_set_lazy_upload(lazy);
+
+	// records of a corrupt capture are not replayed
+	HapticsCaptureRecord corrupt = { .op = HAPTICS_CAPTURE_PLAYER_LOAD_ENABLED, .player = 1000, .effect = -1, .value = 1 };
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_replay_record(&corrupt, NULL, NULL));
+	corrupt.player = -2;
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_replay_record(&corrupt, NULL, NULL));
+	corrupt.op = HAPTICS_CAPTURE_REGISTER_SEQUENCE;
+	corrupt.player = -1;
+	corrupt.value = 0xffffffff;
+	TEST_ASSERT_EQUAL_INT_MESSAGE(-1, Haptics_capture_payload_size(&corrupt), "Step count should not overflow the payload size.");
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_replay_record(&corrupt, NULL, NULL));
+
+	haptics.players[1].effect[2] = -1;
+	haptics.effectDefinitions[2] = definition;
+	haptics.players[1].device = device;
+	haptics.players[1].voices = voices;
+	haptics.players[1].enabled = player_enabled;
+	haptics.enabled = enabled;
+	Haptics_update(0);
+}
+
+void test_Haptics_register_bank(){
+	SDL_HapticEffect effects[3];
+	memset(effects, 0, sizeof(effects));
+	effects[0].type = SDL_HAPTIC_TRIANGLE;
+	effects[0].periodic.direction.type = SDL_HAPTIC_CARTESIAN;
+	effects[0].periodic.direction.dir[1] = -1;
+	effects[0].periodic.length = 800;
+	effects[0].periodic.period = 2;
+	effects[0].periodic.magnitude = 12000;
+	effects[0].periodic.fade_length = 20;
+	effects[1].type = SDL_HAPTIC_LEFTRIGHT;
+	effects[1].leftright.length = 700;
+	effects[1].leftright.small_magnitude = 32767;
+	effects[2].type = SDL_HAPTIC_SPRING;
+	effects[2].condition.length = SDL_HAPTIC_INFINITY;
+	effects[2].condition.right_sat[0] = 0xffff;
+	effects[2].condition.center[2] = -100;
+
+	SDL_HapticEffect definitions[3];
+	int priorities[3];
+	int handles[3];
+	Uint32 registered = haptics.registered[0];
+	Uint32 removed = haptics.removed[0];
+	for(int i = 0; i < 3; i++){
+		definitions[i] = haptics.effectDefinitions[5 + i];
+		priorities[i] = haptics.effectPriorities[5 + i];
+		handles[i] = haptics.effectHandles[5 + i];
+	}
+
+	// entries only hold the fields of their type
+	Uint32 bank[64];
+	HapticsBankHeader *header = (HapticsBankHeader *)bank;
+	char *entries = (char *)(header + 1);
+	int size = 0;
+	for(int i = 0; i < 3; i++){
+		size += Haptics_bank_encode(&effects[i], 5 + i, i, (HapticsBankEntry *)(entries + size));
+	}
+	TEST_ASSERT_TRUE(((HapticsBankEntry *)entries)->size < sizeof(union SDL_HapticEffect));
+	TEST_ASSERT_EQUAL_INT(20, ((HapticsBankEntry *)(entries + ((HapticsBankEntry *)entries)->size))->size);
+	header->magic = HAPTICS_BANK_MAGIC;
+	header->version = HAPTICS_BANK_VERSION;
+	header->count = 3;
+	header->size = size;
+
+	// bad banks register nothing
+	header->size = size - 4;
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_register_bank(bank, sizeof(HapticsBankHeader) + size));
+	header->size = size;
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_register_bank(bank, sizeof(HapticsBankHeader) + size - 4));
+	((HapticsBankEntry *)entries)->index = haptics.max_effects;
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_register_bank(bank, sizeof(HapticsBankHeader) + size));
+	((HapticsBankEntry *)entries)->index = 5;
+	TEST_ASSERT_EQUAL_MEMORY(&definitions[1], &haptics.effectDefinitions[6], sizeof(union SDL_HapticEffect));
+
+	TEST_ASSERT_EQUAL_INT(3, Haptics_register_bank(bank, sizeof(HapticsBankHeader) + size));
+	for(int i = 0; i < 3; i++){
+		TEST_ASSERT_EQUAL_MEMORY(&effects[i], &haptics.effectDefinitions[5 + i], sizeof(union SDL_HapticEffect));
+		TEST_ASSERT_EQUAL_INT(i, haptics.effectPriorities[5 + i]);
+	}
+
+	// effects matching the bank are left alone, whatever their unused bytes hold
+	SDL_HapticEffect padded = haptics.effectDefinitions[6];
+	memset((char *)&padded + sizeof(padded.leftright), 0x5a, sizeof(padded) - sizeof(padded.leftright));
+	haptics.effectDefinitions[6] = padded;
+	TEST_ASSERT_EQUAL_INT(3, Haptics_register_bank(bank, sizeof(HapticsBankHeader) + size));
+	TEST_ASSERT_EQUAL_MEMORY(&padded, &haptics.effectDefinitions[6], sizeof(padded));
+
+	for(int i = 0; i < 3; i++){
+		haptics.effectDefinitions[5 + i] = definitions[i];
+		haptics.effectPriorities[5 + i] = priorities[i];
+		haptics.effectHandles[5 + i] = handles[i];
+	}
+	haptics.registered[0] = registered;
+	haptics.removed[0] = removed;
+	Haptics_update(0);
+}
+
+// Write a bank of a left/right effect at index 5 and a sine effect at index 6.
+static void write_test_bank(const char *path, Uint16 magnitude){
+	SDL_HapticEffect effects[2];
+	memset(effects, 0, sizeof(effects));
+	effects[0].type = SDL_HAPTIC_LEFTRIGHT;
+	effects[0].leftright.length = 100;
+	effects[0].leftright.large_magnitude = 30000;
+	effects[1].type = SDL_HAPTIC_SINE;
+	effects[1].periodic.length = 100;
+	effects[1].periodic.magnitude = magnitude;
+	Uint32 bank[64];
+	HapticsBankHeader *header = (HapticsBankHeader *)bank;
+	char *entries = (char *)(header + 1);
+	int size = Haptics_bank_encode(&effects[0], 5, 0, (HapticsBankEntry *)entries);
+	size += Haptics_bank_encode(&effects[1], 6, 0, (HapticsBankEntry *)(entries + size));
+	header->magic = HAPTICS_BANK_MAGIC;
+	header->version = HAPTICS_BANK_VERSION;
+	header->count = 2;
+	header->size = size;
+	FILE *file = fopen(path, "wb");
+	fwrite(bank, sizeof(HapticsBankHeader) + size, 1, file);
+	fclose(file);
+}
+
+void test_Haptics_watch_bank(){
+	SDL_Haptic *device = haptics.players[1].device;
+	int lazy = haptics.lazy;
+	SDL_HapticEffect definitions[2] = { haptics.effectDefinitions[5], haptics.effectDefinitions[6] };
+	int handles[2] = { haptics.effectHandles[5], haptics.effectHandles[6] };
+	Uint32 registered = haptics.registered[0];
+	Uint32 removed = haptics.removed[0];
+	int freeWord = haptics.freeWord;
+	haptics.lazy = 0;
+	haptics.players[1].device = &haptic1;
+
+	TEST_ASSERT_EQUAL_INT(-1, Haptics_watch_bank("test_missing.bank"));
+	TEST_ASSERT_NULL(haptics.watch);
+	write_test_bank("test_watch.bank", 10000);
+	TEST_ASSERT_EQUAL_INT(2, Haptics_watch_bank("test_watch.bank"));
+	TEST_ASSERT_NOT_NULL(haptics.watch);
+	int uploads = _SDL_HapticNewEffect_count;
+	TEST_ASSERT_TRUE(uploads >= 2);
+
+	// rewriting the same effects uploads nothing
+	write_test_bank("test_watch.bank", 10000);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(uploads, _SDL_HapticNewEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticUpdateEffect_called);
+
+	// a changed effect is updated in place on the device
+	write_test_bank("test_watch.bank", 20000);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(20000, haptics.effectDefinitions[6].periodic.magnitude);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+	TEST_ASSERT_EQUAL_INT(uploads, _SDL_HapticNewEffect_count);
+
+	Haptics_unwatch_bank();
+	TEST_ASSERT_NULL(haptics.watch);
+	write_test_bank("test_watch.bank", 30000);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(20000, haptics.effectDefinitions[6].periodic.magnitude);
+	remove("test_watch.bank");
+
+	Haptics_remove_effect(haptics.effectHandles[5]);
+	Haptics_remove_effect(haptics.effectHandles[6]);
+	haptics.effectDefinitions[5] = definitions[0];
+	haptics.effectDefinitions[6] = definitions[1];
+	haptics.effectHandles[5] = handles[0];
+	haptics.effectHandles[6] = handles[1];
+	haptics.registered[0] = registered;
+	haptics.removed[0] = removed;
+	haptics.freeWord = freeWord;
+	haptics.players[1].device = device;
+	haptics.lazy = lazy;
+	Haptics_update(0);
+}
+
+void test_Haptics_set_background_hotplug(){
+	SDL_Joystick joystick = {};
+	int enabled = haptics.enabled;
+	int lazy = haptics.lazy;
+	int player_enabled[2] = { haptics.players[2].enabled, haptics.players[3].enabled };
+	haptics.enabled = 1;
+	haptics.lazy = 0;
+	haptics.players[2].enabled = 1;
+	for(int i = 0; i < 3; i++){
+		haptics.effectDefinitions[i].type = SDL_HAPTIC_SINE;
+	}
+	// effect 2 was run most recently, then effect 0, then effect 1
+	haptics.effectUsed[2] = haptics.clock + 3;
+	haptics.effectUsed[0] = haptics.clock + 2;
+	haptics.effectUsed[1] = haptics.clock + 1;
+	haptics.clock += 3;
+	Haptics_set_background_hotplug(1);
+
+	// opening uploads nothing
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 2));
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticNewEffect_count);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_player_effect_ready(2, haptics.effectHandles[2]));
+
+	// updates upload the most recently used effects first
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_UPLOADS_PER_UPDATE, _SDL_HapticNewEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_player_effect_ready(2, haptics.effectHandles[2]));
+	TEST_ASSERT_EQUAL_INT(1, Haptics_player_effect_ready(2, haptics.effectHandles[0]));
+	TEST_ASSERT_EQUAL_INT(0, Haptics_player_effect_ready(2, haptics.effectHandles[1]));
+
+	// running an effect not uploaded yet does not block on an upload
+	Haptics_player_run_effect(2, haptics.effectHandles[1], 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_called);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_UPLOADS_PER_UPDATE, _SDL_HapticNewEffect_count);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_player_effect_ready(2, haptics.effectHandles[1]));
+	Haptics_close_for_player(2);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[2].uploading);
+
+	// in async mode the worker opens added controllers
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+	_SDL_HapticOpenFromJoystick_called = 0;
+	Haptics_controller_added(0, 3);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticOpenFromJoystick_called);
+	Haptics_update(0);
+	TEST_ASSERT_NULL(haptics.players[3].device);
+	Haptics_queue_drain(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticOpenFromJoystick_called);
+	Haptics_update(0);
+	TEST_ASSERT_EQUAL_PTR(&haptic1, haptics.players[3].device);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[3].enabled);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[3].uploading);
+	Haptics_close_for_player(3);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(0));
+
+	Haptics_set_background_hotplug(0);
+	for(int i = 0; i < 3; i++){
+		haptics.effectDefinitions[i].type = 0;
+	}
+	haptics.players[2].enabled = player_enabled[0];
+	haptics.players[3].enabled = player_enabled[1];
+	haptics.lazy = lazy;
+	haptics.enabled = enabled;
+	Haptics_update(0);
+}
+
+void test_Haptics_set_threaded(){
+	SDL_HapticEffect sine = { .type = SDL_HAPTIC_SINE };
+	HapticsThreadStats stats;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_threaded(1));
+	TEST_ASSERT_NOT_NULL(haptics.threads);
+	HapticsSnapshot *snapshot = atomic_load(&haptics.threads->snapshot);
+	TEST_ASSERT_NOT_NULL(snapshot);
+	TEST_ASSERT_EQUAL_INT(haptics.max_effects, snapshot->max_effects);
+
+	// registering publishes a new snapshot holding the effect
+	int effect = Haptics_register_effect(&sine);
+	TEST_ASSERT_TRUE(effect >= 0);
+	snapshot = atomic_load(&haptics.threads->snapshot);
+	int index = effect & HAPTICS_HANDLE_INDEX_MASK;
+	TEST_ASSERT_EQUAL_INT(effect, snapshot->handles[index]);
+	TEST_ASSERT_EQUAL_INT(SDL_HAPTIC_SINE, snapshot->definitions[index].type);
+	sine.periodic.period = 50;
+	Haptics_set_effect(&sine, effect);
+	TEST_ASSERT_TRUE(snapshot != atomic_load(&haptics.threads->snapshot));
+	snapshot = atomic_load(&haptics.threads->snapshot);
+	TEST_ASSERT_EQUAL_INT(50, snapshot->definitions[index].periodic.period);
+
+	// triggers from other threads are queued until the next update
+	_SDL_ThreadID_value = 2;
+	Haptics_player_run_effect(0, effect, 1);
+	Haptics_player_stop_effect(0, effect);
+	TEST_ASSERT_EQUAL_UINT(2, atomic_load(&haptics.threads->head));
+	Haptics_player_run_effect(0, effect + HAPTICS_HANDLE_INDEX_MASK + 1, 1);
+	Haptics_player_run_effect(haptics.max_players, effect, 1);
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(0, stats.drained);
+	TEST_ASSERT_EQUAL_UINT(2, stats.rejected);
+	_SDL_ThreadID_value = 1;
+	Haptics_update(0);
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(2, stats.drained);
+	TEST_ASSERT_EQUAL_UINT(2, haptics.threads->tail);
+
+	// a full queue drops triggers
+	_SDL_ThreadID_value = 2;
+	for(int i = 0; i <= HAPTICS_TRIGGER_QUEUE_SIZE; i++){
+		Haptics_player_stop_effect(0, effect);
+	}
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(1, stats.overflows);
+	_SDL_ThreadID_value = 1;
+	Haptics_update(0);
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(2 + HAPTICS_TRIGGER_QUEUE_SIZE, stats.drained);
+
+	// removed effects are rejected once the removal is published
+	Haptics_remove_effect(effect);
+	_SDL_ThreadID_value = 2;
+	Haptics_player_run_effect(0, effect, 1);
+	_SDL_ThreadID_value = 1;
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(3, stats.rejected);
+
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_threaded(0));
+	TEST_ASSERT_NULL(haptics.threads);
+	Haptics_get_thread_stats(&stats);
+	TEST_ASSERT_EQUAL_UINT(0, stats.drained);
+	Haptics_update(0);
+}
+
+void test_Haptics_create_context(){
+	SDL_HapticEffect sine = { .type = SDL_HAPTIC_SINE };
+	HapticsContext *initial = Haptics_get_context();
+	void *tables = haptics.tables;
+	int max_effects = haptics.max_effects;
+
+	HapticsContext *context = Haptics_create_context();
+	TEST_ASSERT_NOT_NULL(context);
+	Haptics_set_context(context);
+	TEST_ASSERT_EQUAL_PTR(context, Haptics_get_context());
+	TEST_ASSERT_NULL(haptics.tables);
+	TEST_ASSERT_EQUAL_INT(1, haptics.enabled);
+
+	// each context has its own tables
+	HapticsConfig config = { .max_players = 2, .max_effects = 8 };
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(&config));
+	TEST_ASSERT_EQUAL_INT(8, haptics.max_effects);
+	TEST_ASSERT_EQUAL_INT(0, Haptics_register_effect(&sine));
+	TEST_ASSERT_TRUE(haptics.registered[0] & 1);
+
+	// the worker issues device calls for the context that started it
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+	TEST_ASSERT_EQUAL_PTR(context, haptics.queue->context);
+
+	// closing closes devices the worker opened but no update collected yet
+	Haptics_set_background_hotplug(1);
+	Haptics_controller_added(0, 1);
+	Haptics_queue_drain(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(0));
+	TEST_ASSERT_NULL(haptics.players[1].device);
+	_SDL_HapticClose_called = 0;
+	Haptics_close();
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticClose_called);
+	TEST_ASSERT_EQUAL_INT(HAPTICS_OPENING_IDLE, atomic_load(&haptics.players[1].opening.state));
+	TEST_ASSERT_NULL(haptics.players[1].device);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+
+	Haptics_set_context(NULL);
+	TEST_ASSERT_EQUAL_PTR(initial, Haptics_get_context());
+	TEST_ASSERT_EQUAL_PTR(tables, haptics.tables);
+	TEST_ASSERT_EQUAL_INT(max_effects, haptics.max_effects);
+	TEST_ASSERT_NULL(haptics.queue);
+
+	// destroying the selected context selects the default context
+	Haptics_set_context(context);
+	Haptics_destroy_context(context);
+	TEST_ASSERT_EQUAL_PTR(initial, Haptics_get_context());
+	Haptics_destroy_context(initial);
+	TEST_ASSERT_EQUAL_PTR(tables, haptics.tables);
+	Haptics_update(0);
+}
+
+// typedef int (config_get_int_t)(const char *key, int *value);
+int config_get_player_0_disabled(const char *key, int *value){
+	*value = 0;
+	return !strcmp(key, "haptics_player_0_enabled");
+}
+
+void test_Haptics_players_refresh(){
+	SDL_Joystick joystick = {};
+	SDL_HapticEffect sine = { .type = SDL_HAPTIC_SINE };
+	sine.periodic.length = 100;
+	SDL_HapticEffect leftright = { .type = SDL_HAPTIC_LEFTRIGHT };
+	leftright.leftright.length = 100;
+	leftright.leftright.large_magnitude = 65535;
+	HapticsContext *context = Haptics_create_context();
+	Haptics_set_context(context);
+	HapticsConfig config = { .max_players = 2, .max_effects = 4 };
+	TEST_ASSERT_EQUAL_INT(1, Haptics_init_with_config(&config));
+	int effect = Haptics_register_effect(&sine);
+	int rumble = Haptics_register_effect(&leftright);
+
+	// a player is playable once its device is open and it is enabled
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 0));
+	TEST_ASSERT_EQUAL_UINT(0, haptics.playable[0]);
+	Haptics_player_set_enabled(0, 1);
+	TEST_ASSERT_EQUAL_UINT(1, haptics.playable[0]);
+
+	// a player with only rumble is playable too
+	_SDL_HapticOpenFromJoystick_value = NULL;
+	_SDL_JoystickRumble_value = 0;
+	TEST_ASSERT_EQUAL_INT(1, Haptics_open_joystick_for_player(&joystick, 1));
+	Haptics_player_set_enabled(1, 1);
+	TEST_ASSERT_EQUAL_UINT(3, haptics.playable[0]);
+	_SDL_JoystickRumble_count = 0;
+	Haptics_player_run_effect(1, rumble, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_JoystickRumble_count);
+
+	// a loaded setting disabling a player drops its triggers
+	Haptics_settings_load(config_get_player_0_disabled);
+	TEST_ASSERT_EQUAL_UINT(2, haptics.playable[0]);
+	_SDL_HapticRunEffect_count = 0;
+	Haptics_player_run_effect(0, effect, 1);
+	TEST_ASSERT_EQUAL_INT(0, _SDL_HapticRunEffect_count);
+	Haptics_player_set_enabled(0, 1);
+	Haptics_player_run_effect(0, effect, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+
+	// disabling haptics clears every player
+	Haptics_set_enabled(0);
+	TEST_ASSERT_EQUAL_UINT(0, haptics.playable[0]);
+	Haptics_player_run_effect(0, effect, 1);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticRunEffect_count);
+	Haptics_set_enabled(1);
+	TEST_ASSERT_EQUAL_UINT(3, haptics.playable[0]);
+
+	// closing clears a player
+	Haptics_close_for_player(0);
+	TEST_ASSERT_EQUAL_UINT(2, haptics.playable[0]);
+	Haptics_close();
+	TEST_ASSERT_EQUAL_UINT(0, haptics.playable[0]);
+
+	_SDL_HapticOpenFromJoystick_value = &haptic1;
+	_SDL_JoystickRumble_value = -1;
+	Haptics_set_context(NULL);
+	Haptics_destroy_context(context);
+}
+
+void test_Haptics_run_effect_mask(){
+	HapticsCounters players[4];
+	HapticsCounters effects[4];
+	HapticsStats stats = { .players = players, .player_count = 4, .effects = effects, .effect_count = 4 };
+	HapticsPlayer saved[4];
+	memcpy(saved, haptics.players, sizeof(saved));
+	int enabled = haptics.enabled;
+	int lazy = haptics.lazy;
+	SDL_HapticEffect definition = haptics.effectDefinitions[2];
+	haptics.enabled = 1;
+	haptics.lazy = 0;
+	// players 0 and 2 can play, player 1 is disabled, player 3 has no device
+	for(int p = 0; p < 3; p++){
+		haptics.players[p].device = &haptic1;
+		haptics.players[p].enabled = (p != 1);
+		haptics.players[p].mixing = 0;
+		haptics.players[p].voices = 0;
+		haptics.players[p].paused = 0;
+		haptics.players[p].effect[2] = 0;
+	}
+	haptics.players[3].device = NULL;
+	haptics.players[3].rumble = NULL;
+	Haptics_players_refresh();
+	haptics.effectDefinitions[2].type = SDL_HAPTIC_CONSTANT;
+	int handle = haptics.effectHandles[2];
+	Haptics_reset_stats();
+
+	Haptics_run_effect_mask(0xf, handle, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_get_stats(&stats));
+	TEST_ASSERT_EQUAL_INT(4, stats.total.triggers);
+	TEST_ASSERT_EQUAL_INT(1, players[1].drops[HAPTICS_DROP_DISABLED]);
+	TEST_ASSERT_EQUAL_INT(1, players[3].drops[HAPTICS_DROP_DISCONNECTED]);
+
+	// stale handles and players past the player count run nothing
+	Haptics_run_effect_mask(0xf, handle + (1 << HAPTICS_HANDLE_INDEX_BITS), 1);
+	Haptics_run_effect_mask(~0xfu, handle, 1);
+	TEST_ASSERT_EQUAL_INT(2, _SDL_HapticRunEffect_count);
+
+	// stops, pauses and updates reach connected players, enabled or not
+	Haptics_stop_effect_mask(0x2, handle);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticStopEffect_called);
+	Haptics_pause_mask(0xa);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[0].paused);
+	TEST_ASSERT_EQUAL_INT(1, haptics.players[1].paused);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[3].paused);
+	Haptics_unpause_mask(0xa);
+	TEST_ASSERT_EQUAL_INT(0, haptics.players[1].paused);
+	SDL_HapticEffect stronger = { .type = SDL_HAPTIC_CONSTANT };
+	stronger.constant.level = 0x7fff;
+	Haptics_update_effect_mask(0x5, handle, &stronger);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_HapticUpdateEffect_called);
+
+	// in async mode the worker is woken once for the group
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(1));
+	unsigned int queued = haptics.queue->queued;
+	_SDL_SemPost_count = 0;
+	Haptics_run_effect_mask(0x5, handle, 1);
+	TEST_ASSERT_EQUAL_INT(queued + 2, haptics.queue->queued);
+	TEST_ASSERT_EQUAL_INT(1, _SDL_SemPost_count);
+	Haptics_queue_drain(haptics.queue);
+	TEST_ASSERT_EQUAL_INT(4, _SDL_HapticRunEffect_count);
+	TEST_ASSERT_EQUAL_INT(1, Haptics_set_async(0));
+
+	haptics.effectDefinitions[2] = definition;
+	memcpy(haptics.players, saved, sizeof(saved));
+	haptics.lazy = lazy;
+	haptics.enabled = enabled;
+	Haptics_players_refresh();
+	Haptics_update(0);
+}
 
 int main(){
 	UNITY_BEGIN();
 	RUN_TEST(test_Haptics_init);
+	RUN_TEST(test_Haptics_init_with_config);
 	RUN_TEST(test_Haptics_pause_all);
 	RUN_TEST(test_Haptics_unpause_all);
 	RUN_TEST(test_Haptics_player_pause_all);
@@ -318,16 +2013,42 @@ int main(){
 	RUN_TEST(test_Haptics_set_enabled);
 	RUN_TEST(test_Haptics_player_set_enabled);
 	RUN_TEST(test_Haptics_player_set_gain);
+	RUN_TEST(test_Haptics_player_set_gain_applied);
+	RUN_TEST(test_Haptics_set_lazy_upload);
+	RUN_TEST(test_Haptics_set_async);
+	RUN_TEST(test_Haptics_sync);
+	RUN_TEST(test_Haptics_set_batched);
+	RUN_TEST(test_Haptics_flush);
 	RUN_TEST(test_Haptics_settings_load);
 	RUN_TEST(test_Haptics_settings_save);
+	RUN_TEST(test_Haptics_settings_save_batch);
 	RUN_TEST(test_Haptics_open_joystick_for_player);
+	RUN_TEST(test_Haptics_open_joystick_for_player_rumble);
 	RUN_TEST(test_Haptics_register_effect);
 	RUN_TEST(test_Haptics_register_effect_at);
 	RUN_TEST(test_Haptics_remove_effect);
+	RUN_TEST(test_Haptics_remove_effect_stale_handle);
 	RUN_TEST(test_Haptics_set_effect);
 	RUN_TEST(test_Haptics_player_run_effect);
 	RUN_TEST(test_Haptics_player_update_effect);
+	RUN_TEST(test_Haptics_set_effect_in_place);
 	RUN_TEST(test_Haptics_player_stop_effect);
+	RUN_TEST(test_Haptics_set_effect_priority);
+	RUN_TEST(test_Haptics_effect_length);
+	RUN_TEST(test_Haptics_set_effect_retrigger);
+	RUN_TEST(test_Haptics_player_run_sequence);
+	RUN_TEST(test_Haptics_set_mixing);
+	RUN_TEST(test_Haptics_set_backend);
+	RUN_TEST(test_Haptics_get_stats);
+	RUN_TEST(test_Haptics_set_tracing);
+	RUN_TEST(test_Haptics_start_capture);
+	RUN_TEST(test_Haptics_register_bank);
+	RUN_TEST(test_Haptics_watch_bank);
+	RUN_TEST(test_Haptics_set_background_hotplug);
+	RUN_TEST(test_Haptics_set_threaded);
+	RUN_TEST(test_Haptics_create_context);
+	RUN_TEST(test_Haptics_players_refresh);
+	RUN_TEST(test_Haptics_run_effect_mask);
 
 	return UNITY_END();
 }
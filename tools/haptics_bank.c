@@ -0,0 +1,316 @@
+/*
+ * Copyright 2024 Roger Feese
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "../src/haptics.h"
+
+// Compile an effect bank, loaded by Haptics_load_bank, from a text description.
+//
+// usage: haptics_bank effects.txt effects.bank
+//
+// Each effect starts with "effect <index> <type>", followed by one
+// "<field> <values>" line per field it sets. Fields left out are 0.
+// Blank lines and lines starting with # are ignored.
+//
+//	# short buzz on both motors
+//	effect 1 sine
+//	direction polar 0
+//	period 25
+//	magnitude 15000
+//	length 100
+//	priority 2
+//
+// Types: constant, sine, triangle, sawtoothup, sawtoothdown, ramp, spring,
+// damper, inertia, friction, leftright. Lengths may be "infinity".
+
+typedef struct BankType {
+	const char *name;
+	Uint16 type;
+} BankType;
+
+static const BankType bank_types[] = {
+	{ "constant", SDL_HAPTIC_CONSTANT },
+	{ "sine", SDL_HAPTIC_SINE },
+	{ "triangle", SDL_HAPTIC_TRIANGLE },
+	{ "sawtoothup", SDL_HAPTIC_SAWTOOTHUP },
+	{ "sawtoothdown", SDL_HAPTIC_SAWTOOTHDOWN },
+	{ "ramp", SDL_HAPTIC_RAMP },
+	{ "spring", SDL_HAPTIC_SPRING },
+	{ "damper", SDL_HAPTIC_DAMPER },
+	{ "inertia", SDL_HAPTIC_INERTIA },
+	{ "friction", SDL_HAPTIC_FRICTION },
+	{ "leftright", SDL_HAPTIC_LEFTRIGHT },
+};
+
+static const char *bank_directions[] = { "polar", "cartesian", "spherical", "steeringaxis" };
+
+// Fields of an effect, with up to three values each
+enum BankField {
+	FIELD_PRIORITY,
+	FIELD_LENGTH,
+	FIELD_DELAY,
+	FIELD_BUTTON,
+	FIELD_INTERVAL,
+	FIELD_DIRECTION, // type followed by up to three values
+	FIELD_LEVEL,
+	FIELD_PERIOD,
+	FIELD_MAGNITUDE,
+	FIELD_OFFSET,
+	FIELD_PHASE,
+	FIELD_START,
+	FIELD_END,
+	FIELD_ATTACK_LENGTH,
+	FIELD_ATTACK_LEVEL,
+	FIELD_FADE_LENGTH,
+	FIELD_FADE_LEVEL,
+	FIELD_LARGE_MAGNITUDE,
+	FIELD_SMALL_MAGNITUDE,
+	FIELD_RIGHT_SAT,
+	FIELD_LEFT_SAT,
+	FIELD_RIGHT_COEFF,
+	FIELD_LEFT_COEFF,
+	FIELD_DEADBAND,
+	FIELD_CENTER,
+	FIELDS
+};
+
+static const char *bank_fields[FIELDS] = { "priority", "length", "delay", "button", "interval", "direction", "level", "period", "magnitude", "offset", "phase", "start", "end", "attack_length", "attack_level", "fade_length", "fade_level", "large_magnitude", "small_magnitude", "right_sat", "left_sat", "right_coeff", "left_coeff", "deadband", "center" };
+
+// Effect being read
+typedef struct BankEffect {
+	int index;
+	Uint16 type;
+	Uint8 direction;
+	long values[FIELDS][3];
+} BankEffect;
+
+// Bank being written
+typedef struct Bank {
+	char *data;
+	size_t size;
+	size_t capacity;
+	Uint32 count;
+} Bank;
+
+// Effect definition
+static union SDL_HapticEffect Bank_definition(const BankEffect *effect){
+	const long (*v)[3] = effect->values;
+	union SDL_HapticEffect definition;
+	memset(&definition, 0, sizeof(definition));
+	definition.type = effect->type;
+	if(effect->type == SDL_HAPTIC_LEFTRIGHT){
+		definition.leftright.length = v[FIELD_LENGTH][0];
+		definition.leftright.large_magnitude = v[FIELD_LARGE_MAGNITUDE][0];
+		definition.leftright.small_magnitude = v[FIELD_SMALL_MAGNITUDE][0];
+		return definition;
+	}
+
+	// every other type starts with the same fields
+	definition.constant.direction.type = effect->direction;
+	for(int i = 0; i < 3; i++){
+		definition.constant.direction.dir[i] = v[FIELD_DIRECTION][i];
+	}
+	definition.constant.length = v[FIELD_LENGTH][0];
+	definition.constant.delay = v[FIELD_DELAY][0];
+	definition.constant.button = v[FIELD_BUTTON][0];
+	definition.constant.interval = v[FIELD_INTERVAL][0];
+	switch(effect->type){
+		case SDL_HAPTIC_CONSTANT:
+			definition.constant.level = v[FIELD_LEVEL][0];
+			definition.constant.attack_length = v[FIELD_ATTACK_LENGTH][0];
+			definition.constant.attack_level = v[FIELD_ATTACK_LEVEL][0];
+			definition.constant.fade_length = v[FIELD_FADE_LENGTH][0];
+			definition.constant.fade_level = v[FIELD_FADE_LEVEL][0];
+			break;
+		case SDL_HAPTIC_RAMP:
+			definition.ramp.start = v[FIELD_START][0];
+			definition.ramp.end = v[FIELD_END][0];
+			definition.ramp.attack_length = v[FIELD_ATTACK_LENGTH][0];
+			definition.ramp.attack_level = v[FIELD_ATTACK_LEVEL][0];
+			definition.ramp.fade_length = v[FIELD_FADE_LENGTH][0];
+			definition.ramp.fade_level = v[FIELD_FADE_LEVEL][0];
+			break;
+		case SDL_HAPTIC_SPRING:
+		case SDL_HAPTIC_DAMPER:
+		case SDL_HAPTIC_INERTIA:
+		case SDL_HAPTIC_FRICTION:
+			for(int i = 0; i < 3; i++){
+				definition.condition.right_sat[i] = v[FIELD_RIGHT_SAT][i];
+				definition.condition.left_sat[i] = v[FIELD_LEFT_SAT][i];
+				definition.condition.right_coeff[i] = v[FIELD_RIGHT_COEFF][i];
+				definition.condition.left_coeff[i] = v[FIELD_LEFT_COEFF][i];
+				definition.condition.deadband[i] = v[FIELD_DEADBAND][i];
+				definition.condition.center[i] = v[FIELD_CENTER][i];
+			}
+			break;
+		default:
+			definition.periodic.period = v[FIELD_PERIOD][0];
+			definition.periodic.magnitude = v[FIELD_MAGNITUDE][0];
+			definition.periodic.offset = v[FIELD_OFFSET][0];
+			definition.periodic.phase = v[FIELD_PHASE][0];
+			definition.periodic.attack_length = v[FIELD_ATTACK_LENGTH][0];
+			definition.periodic.attack_level = v[FIELD_ATTACK_LEVEL][0];
+			definition.periodic.fade_length = v[FIELD_FADE_LENGTH][0];
+			definition.periodic.fade_level = v[FIELD_FADE_LEVEL][0];
+	}
+	return definition;
+}
+
+// Append an effect to the bank, returning 0 when out of memory
+static int Bank_add(Bank *bank, const BankEffect *effect){
+	if((bank->size + sizeof(HapticsBankEntry)) > bank->capacity){
+		size_t capacity = bank->capacity ? (bank->capacity * 2) : 4096;
+		char *data = realloc(bank->data, capacity);
+		if(!data){
+			return 0;
+		}
+		bank->data = data;
+		bank->capacity = capacity;
+	}
+	union SDL_HapticEffect definition = Bank_definition(effect);
+	HapticsBankEntry entry;
+	int size = Haptics_bank_encode(&definition, effect->index, effect->values[FIELD_PRIORITY][0], &entry);
+	memcpy(bank->data + bank->size, &entry, size);
+	bank->size += size;
+	bank->count++;
+	return 1;
+}
+
+// Value of a field, 0 when it is not a number
+static int Bank_value(const char *token, long *value){
+	if(!strcmp(token, "infinity")){
+		*value = SDL_HAPTIC_INFINITY;
+		return 1;
+	}
+	char *end;
+	*value = strtol(token, &end, 0);
+	return (end != token) && !*end;
+}
+
+static int Bank_error(const char *path, int line, const char *message, const char *token){
+	fprintf(stderr, "%s:%d: %s%s%s\n", path, line, message, token ? " " : "", token ? token : "");
+	return 0;
+}
+
+// Read the effects of a text description into the bank, returning 0 on errors
+static int Bank_read(const char *path, FILE *file, Bank *bank){
+	char text[512];
+	int line = 0;
+	BankEffect effect;
+	int reading = 0;
+	while(fgets(text, sizeof(text), file)){
+		line++;
+		char *token = strtok(text, " \t\r\n");
+		if(!token || (token[0] == '#')){
+			continue;
+		}
+
+		if(!strcmp(token, "effect")){
+			if(reading && !Bank_add(bank, &effect)){
+				return Bank_error(path, line, "out of memory", NULL);
+			}
+			memset(&effect, 0, sizeof(effect));
+			long index;
+			char *value = strtok(NULL, " \t\r\n");
+			if(!value || !Bank_value(value, &index) || (index < 0)){
+				return Bank_error(path, line, "expected effect index, got", value);
+			}
+			effect.index = index;
+			char *type = strtok(NULL, " \t\r\n");
+			for(int t = 0; type && (t < (int)(sizeof(bank_types) / sizeof(bank_types[0]))); t++){
+				if(!strcmp(type, bank_types[t].name)){
+					effect.type = bank_types[t].type;
+				}
+			}
+			if(!effect.type){
+				return Bank_error(path, line, "unknown effect type", type);
+			}
+			reading = 1;
+			continue;
+		}
+
+		if(!reading){
+			return Bank_error(path, line, "field before the first effect:", token);
+		}
+		int field = 0;
+		while((field < FIELDS) && strcmp(token, bank_fields[field])){
+			field++;
+		}
+		if(field == FIELDS){
+			return Bank_error(path, line, "unknown field", token);
+		}
+		if(field == FIELD_DIRECTION){
+			char *type = strtok(NULL, " \t\r\n");
+			int d = 0;
+			while(type && (d < 4) && strcmp(type, bank_directions[d])){
+				d++;
+			}
+			if(d == 4){
+				return Bank_error(path, line, "unknown direction type", type);
+			}
+			effect.direction = d;
+		}
+		int count = 0;
+		char *value;
+		while((value = strtok(NULL, " \t\r\n"))){
+			if((count == 3) || !Bank_value(value, &effect.values[field][count])){
+				return Bank_error(path, line, "bad value", value);
+			}
+			count++;
+		}
+		if(!count){
+			return Bank_error(path, line, "missing value for", token);
+		}
+	}
+	if(reading && !Bank_add(bank, &effect)){
+		return Bank_error(path, line, "out of memory", NULL);
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[]){
+	if(argc != 3){
+		fprintf(stderr, "usage: %s effects.txt effects.bank\n", argv[0]);
+		return 1;
+	}
+	FILE *input = fopen(argv[1], "r");
+	if(!input){
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	Bank bank = { 0 };
+	int read = Bank_read(argv[1], input, &bank);
+	fclose(input);
+	if(!read){
+		return 1;
+	}
+
+	// the bank is written aside and renamed over the old one, so a game reloading it never sees a partial file
+	HapticsBankHeader header = { HAPTICS_BANK_MAGIC, HAPTICS_BANK_VERSION, bank.count, bank.size };
+	size_t length = strlen(argv[2]);
+	char *temporary = malloc(length + 5);
+	if(!temporary){
+		return 1;
+	}
+	memcpy(temporary, argv[2], length);
+	memcpy(temporary + length, ".tmp", 5);
+	FILE *output = fopen(temporary, "wb");
+	if(!output){
+		fprintf(stderr, "%s: cannot write %s\n", argv[0], temporary);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, output);
+	fwrite(bank.data, 1, bank.size, output);
+	if((ferror(output) | fclose(output)) || (rename(temporary, argv[2]) != 0)){
+		fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[2]);
+		remove(temporary);
+		return 1;
+	}
+	free(temporary);
+	printf("%s: %u effects, %zu bytes\n", argv[2], bank.count, sizeof(header) + bank.size);
+	free(bank.data);
+	return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2024 Roger Feese
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "../src/haptics.h"
+
+// Replay a capture written by Haptics_start_capture through a mock backend, as fast as possible.
+//
+// usage: haptics_replay capture
+//
+// Output is CSV: records replayed, backend calls made, results differing
+// from the capture, captured and replayed durations.
+
+// Mock backend, counting calls
+static unsigned long replay_calls; // backend calls made
+static int replay_device; // device handle of every mock device
+static char replay_joystick; // joystick stand-in for replayed opens
+static int replay_next_effect; // next device effect identifier
+
+static int Mock_init(void *data){
+	return 0;
+}
+
+static void *Mock_open(void *data, SDL_Joystick *joystick, HapticsDeviceInfo *info){
+	replay_calls++;
+	info->effects = 0;
+	info->playing = 0;
+	info->features = SDL_HAPTIC_CONSTANT | SDL_HAPTIC_SINE | SDL_HAPTIC_LEFTRIGHT | SDL_HAPTIC_GAIN;
+	return &replay_device;
+}
+
+static void Mock_close(void *data, void *device){
+	replay_calls++;
+}
+
+static int Mock_new_effect(void *data, void *device, union SDL_HapticEffect *effect){
+	replay_calls++;
+	return replay_next_effect++;
+}
+
+static int Mock_update_effect(void *data, void *device, int effect, union SDL_HapticEffect *definition){
+	replay_calls++;
+	return 0;
+}
+
+static void Mock_destroy_effect(void *data, void *device, int effect){
+	replay_calls++;
+}
+
+static int Mock_run_effect(void *data, void *device, int effect, Uint32 iterations){
+	replay_calls++;
+	return 0;
+}
+
+static int Mock_effect_call(void *data, void *device, int effect){
+	replay_calls++;
+	return 0;
+}
+
+static int Mock_call(void *data, void *device){
+	replay_calls++;
+	return 0;
+}
+
+static int Mock_set_gain(void *data, void *device, int gain){
+	replay_calls++;
+	return 0;
+}
+
+static int Mock_rumble(void *data, SDL_Joystick *joystick, Uint16 low, Uint16 high, Uint32 duration_ms){
+	replay_calls++;
+	return 0;
+}
+
+static const HapticsBackend mock_backend = { NULL, Mock_init, Mock_open, Mock_close, Mock_new_effect, Mock_update_effect, Mock_destroy_effect, Mock_run_effect, Mock_effect_call, Mock_call, Mock_call, Mock_call, Mock_set_gain, Mock_rumble };
+
+// Capture file
+static char *Replay_load(const char *path, long *size){
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char *data = malloc(*size);
+	if(data && (fread(data, 1, *size, file) != (size_t)*size)){
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	return data;
+}
+
+static inline long long Replay_now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((long long)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+// - Result the capture expects from a record, or 0 when it records none
+static int Replay_expected(const HapticsCaptureRecord *record){
+	switch(record->op){
+		case HAPTICS_CAPTURE_REGISTER_EFFECT:
+		case HAPTICS_CAPTURE_REGISTER_SEQUENCE:
+			return record->effect;
+		case HAPTICS_CAPTURE_OPEN:
+			return record->value;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	if(argc < 2){
+		fprintf(stderr, "usage: %s capture\n", argv[0]);
+		return 1;
+	}
+	long size = 0;
+	char *data = Replay_load(argv[1], &size);
+	if(!data){
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	HapticsCaptureHeader header = { 0 };
+	if(size >= (long)sizeof(header)){
+		memcpy(&header, data, sizeof(header));
+	}
+	if(header.magic != HAPTICS_CAPTURE_MAGIC){
+		fprintf(stderr, "%s: %s is not a capture\n", argv[0], argv[1]);
+		return 1;
+	}
+	if((header.version != HAPTICS_CAPTURE_VERSION) || (header.definition_size != sizeof(union SDL_HapticEffect)) || (header.step_size != sizeof(HapticsStep))){
+		fprintf(stderr, "%s: %s was captured by an incompatible build\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	unsigned long records = 0;
+	unsigned long divergences = 0;
+	unsigned long long captured_us = 0;
+	Haptics_set_backend(&mock_backend);
+	if(!Haptics_init_with_config(&header.config)){
+		fprintf(stderr, "%s: init failed\n", argv[0]);
+		return 1;
+	}
+	Haptics_set_lazy_upload(header.lazy);
+	Haptics_set_mixing(header.mixing);
+
+	long long start = Replay_now();
+	long offset = sizeof(header);
+	while((offset + (long)sizeof(HapticsCaptureRecord)) <= size){
+		HapticsCaptureRecord record;
+		memcpy(&record, data + offset, sizeof(record));
+		offset += sizeof(record);
+		int payload = Haptics_capture_payload_size(&record);
+		if((payload < 0) || ((offset + payload) > size)){
+			break;
+		}
+		if(Haptics_replay_record(&record, data + offset, (SDL_Joystick *)&replay_joystick) != Replay_expected(&record)){
+			divergences++;
+		}
+		offset += payload;
+		captured_us += record.delta_us;
+		records++;
+	}
+	long long elapsed = Replay_now() - start;
+	Haptics_close();
+
+	printf("records,backend_calls,divergences,captured_us,replay_ns,ns_per_record\n");
+	printf("%lu,%lu,%lu,%llu,%lld,%.1f\n", records, replay_calls, divergences, captured_us, elapsed, records ? ((double)elapsed / records) : 0.0);
+	free(data);
+	return divergences ? 2 : 0;
+}